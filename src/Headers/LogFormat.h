@@ -0,0 +1,700 @@
+#pragma once
+
+// 
+// Compact encoding of the arguments of a printf-style format string.
+// 
+// Instead of expanding a message to its full text, the arguments consumed by the format string are serialized
+// one after the other, in the order they are read, without any padding or type tag: the format string itself
+// describes how to decode them.
+// 
+//  - '*' widths and precisions, integers up to 32-bits and characters are stored on 4 bytes.
+//  - 64-bits integers, pointers (even from a 32-bits producer) and floating point values are stored on 8 bytes.
+//  - Strings (%s, %S, %hs, %ls, %ws, %Z, %wZ) are stored as a 4 bytes length in bytes, followed by the characters
+//    without their null-terminator. A null string has a length of MAXULONG, and no characters.
+// 
+// This header only depends on the basic Windows types and on _snwprintf, so it can be included by a user-mode agent
+// after <windows.h>. It has no wide string literal either, so a tool which reads the UTF-16 messages on another platform
+// can include it with a 16-bits WCHAR, and its own _snwprintf.
+// 
+
+#define LOG_FORMAT_ARGUMENT_NONE 0
+#define LOG_FORMAT_ARGUMENT_INT32 1
+#define LOG_FORMAT_ARGUMENT_INT64 2
+#define LOG_FORMAT_ARGUMENT_POINTER 3
+#define LOG_FORMAT_ARGUMENT_DOUBLE 4
+#define LOG_FORMAT_ARGUMENT_STRING 5
+#define LOG_FORMAT_ARGUMENT_COUNTED_STRING 6
+#define LOG_FORMAT_ARGUMENT_INVALID 7
+
+#define LOG_FORMAT_NULL_STRING MAXULONG
+
+/// <summary>
+/// A single conversion specification of a format string.
+/// </summary>
+typedef struct _LOG_FORMAT_SPEC
+{
+	/// <summary>
+	/// The flags of the conversion.
+	/// </summary>
+	CONST WCHAR* Flags;
+
+	/// <summary>
+	/// The number of flags of the conversion.
+	/// </summary>
+	ULONG NumberOfFlags;
+
+	/// <summary>
+	/// Whether the width is read from the arguments.
+	/// </summary>
+	BOOLEAN IsWidthArgument;
+
+	/// <summary>
+	/// The width of the conversion, or -1 if none was specified.
+	/// </summary>
+	LONG Width;
+
+	/// <summary>
+	/// Whether the precision is read from the arguments.
+	/// </summary>
+	BOOLEAN IsPrecisionArgument;
+
+	/// <summary>
+	/// The precision of the conversion, or -1 if none was specified.
+	/// </summary>
+	LONG Precision;
+
+	/// <summary>
+	/// The type of the argument, one of the LOG_FORMAT_ARGUMENT_* values.
+	/// </summary>
+	ULONG ArgumentType;
+
+	/// <summary>
+	/// For characters and strings, whether they are made of wide characters.
+	/// </summary>
+	BOOLEAN IsWide;
+
+	/// <summary>
+	/// The conversion character, in its canonical form.
+	/// </summary>
+	WCHAR Conversion;
+
+} LOG_FORMAT_SPEC;
+
+/// <summary>
+/// The layout shared by the ANSI_STRING and UNICODE_STRING structures.
+/// </summary>
+typedef struct _LOG_FORMAT_COUNTED_STRING
+{
+	USHORT Length;
+	USHORT MaximumLength;
+	CONST VOID* Buffer;
+
+} LOG_FORMAT_COUNTED_STRING;
+
+/// <summary>
+/// Parses a conversion specification.
+/// </summary>
+/// <param name="InSpec">The characters following the '%' sign.</param>
+/// <param name="OutSpec">The parsed specification.</param>
+/// <returns>The first character following the conversion specification.</returns>
+inline CONST WCHAR* LogFormatParseSpec(CONST WCHAR* InSpec, LOG_FORMAT_SPEC* OutSpec)
+{
+	auto* Cursor = InSpec;
+
+	OutSpec->Flags = Cursor;
+	OutSpec->NumberOfFlags = 0;
+	OutSpec->IsWidthArgument = FALSE;
+	OutSpec->Width = -1;
+	OutSpec->IsPrecisionArgument = FALSE;
+	OutSpec->Precision = -1;
+	OutSpec->ArgumentType = LOG_FORMAT_ARGUMENT_INVALID;
+	OutSpec->IsWide = TRUE;
+	OutSpec->Conversion = L'\0';
+
+	// 
+	// Parse the flags, the width and the precision.
+	// 
+
+	while (*Cursor == L'-' || *Cursor == L'+' || *Cursor == L' ' || *Cursor == L'#' || *Cursor == L'0')
+		++OutSpec->NumberOfFlags, ++Cursor;
+
+	if (OutSpec->NumberOfFlags > 8)
+		return Cursor;
+
+	if (*Cursor == L'*')
+	{
+		OutSpec->IsWidthArgument = TRUE;
+		++Cursor;
+	}
+	else
+	{
+		for (OutSpec->Width = (*Cursor >= L'0' && *Cursor <= L'9') ? 0 : -1; *Cursor >= L'0' && *Cursor <= L'9'; ++Cursor)
+		{
+			if (OutSpec->Width >= 100000)
+				return Cursor;
+
+			OutSpec->Width = OutSpec->Width * 10 + (*Cursor - L'0');
+		}
+	}
+
+	if (*Cursor == L'.')
+	{
+		++Cursor;
+
+		if (*Cursor == L'*')
+		{
+			OutSpec->IsPrecisionArgument = TRUE;
+			++Cursor;
+		}
+		else
+		{
+			for (OutSpec->Precision = 0; *Cursor >= L'0' && *Cursor <= L'9'; ++Cursor)
+			{
+				if (OutSpec->Precision >= 100000)
+					return Cursor;
+
+				OutSpec->Precision = OutSpec->Precision * 10 + (*Cursor - L'0');
+			}
+		}
+	}
+
+	// 
+	// Parse the size and width modifiers.
+	// 
+
+	BOOLEAN IsNarrow = FALSE;
+	BOOLEAN IsExplicitlyWide = FALSE;
+	BOOLEAN Is64Bits = FALSE;
+	BOOLEAN IsPointerSized = FALSE;
+
+	switch (*Cursor)
+	{
+		case L'h':
+			IsNarrow = TRUE;
+			Cursor += (Cursor[1] == L'h') ? 2 : 1;
+			break;
+
+		case L'l':
+			if (Cursor[1] == L'l')
+				Is64Bits = TRUE, Cursor += 2;
+			else
+				IsExplicitlyWide = TRUE, Cursor += 1;
+			break;
+
+		case L'w':
+			IsExplicitlyWide = TRUE;
+			Cursor += 1;
+			break;
+
+		case L'L':
+			Cursor += 1;
+			break;
+
+		case L'I':
+			if (Cursor[1] == L'6' && Cursor[2] == L'4')
+				Is64Bits = TRUE, Cursor += 3;
+			else if (Cursor[1] == L'3' && Cursor[2] == L'2')
+				Cursor += 3;
+			else
+				IsPointerSized = TRUE, Cursor += 1;
+			break;
+
+		case L'z':
+		case L't':
+			IsPointerSized = TRUE;
+			Cursor += 1;
+			break;
+
+		case L'j':
+			Is64Bits = TRUE;
+			Cursor += 1;
+			break;
+	}
+
+	if (IsPointerSized && sizeof(PVOID) == sizeof(LONG64))
+		Is64Bits = TRUE;
+
+	// 
+	// Parse the conversion character.
+	// 
+
+	switch (*Cursor)
+	{
+		case L'd':
+		case L'i':
+		case L'o':
+		case L'u':
+		case L'x':
+		case L'X':
+			OutSpec->ArgumentType = Is64Bits ? LOG_FORMAT_ARGUMENT_INT64 : LOG_FORMAT_ARGUMENT_INT32;
+			OutSpec->Conversion = (*Cursor == L'i') ? L'd' : *Cursor;
+			break;
+
+		case L'c':
+		case L's':
+			OutSpec->ArgumentType = (*Cursor == L'c') ? LOG_FORMAT_ARGUMENT_INT32 : LOG_FORMAT_ARGUMENT_STRING;
+			OutSpec->IsWide = !IsNarrow;
+			OutSpec->Conversion = *Cursor;
+			break;
+
+		case L'C':
+		case L'S':
+			OutSpec->ArgumentType = (*Cursor == L'C') ? LOG_FORMAT_ARGUMENT_INT32 : LOG_FORMAT_ARGUMENT_STRING;
+			OutSpec->IsWide = IsExplicitlyWide;
+			OutSpec->Conversion = (*Cursor == L'C') ? L'c' : L's';
+			break;
+
+		case L'Z':
+			OutSpec->ArgumentType = LOG_FORMAT_ARGUMENT_COUNTED_STRING;
+			OutSpec->IsWide = IsExplicitlyWide;
+			OutSpec->Conversion = L's';
+			break;
+
+		case L'p':
+			OutSpec->ArgumentType = LOG_FORMAT_ARGUMENT_POINTER;
+			OutSpec->Conversion = L'p';
+			break;
+
+		case L'e':
+		case L'E':
+		case L'f':
+		case L'F':
+		case L'g':
+		case L'G':
+		case L'a':
+		case L'A':
+			OutSpec->ArgumentType = LOG_FORMAT_ARGUMENT_DOUBLE;
+			OutSpec->Conversion = *Cursor;
+			break;
+
+		case L'%':
+			OutSpec->ArgumentType = LOG_FORMAT_ARGUMENT_NONE;
+			OutSpec->Conversion = L'%';
+			break;
+
+		default:
+			return Cursor;
+	}
+
+	return Cursor + 1;
+}
+
+/// <summary>
+/// Serializes the arguments consumed by a format string.
+/// Strings are truncated if they do not fit in the output buffer.
+/// </summary>
+/// <param name="InFormat">The format string.</param>
+/// <param name="InArguments">The arguments of the format string.</param>
+/// <param name="OutBuffer">The buffer receiving the encoded arguments.</param>
+/// <param name="InCapacity">The size of the output buffer, in bytes.</param>
+/// <param name="OutLength">The number of bytes written to the output buffer.</param>
+/// <returns>FALSE if the format string is not supported, or if the arguments do not fit in the output buffer.</returns>
+inline BOOLEAN LogFormatEncode(CONST WCHAR* InFormat, va_list InArguments, UCHAR* OutBuffer, ULONG InCapacity, ULONG* OutLength)
+{
+	ULONG Length = 0;
+
+	auto Append = [&] (CONST VOID* InData, ULONG InSize) -> BOOLEAN
+	{
+		if (InCapacity - Length < InSize)
+			return FALSE;
+
+		RtlCopyMemory(OutBuffer + Length, InData, InSize);
+		Length += InSize;
+		return TRUE;
+	};
+
+	auto AppendString = [&] (CONST VOID* InString, SIZE_T InByteLength, SIZE_T InCharacterSize) -> BOOLEAN
+	{
+		ULONG ByteLength = LOG_FORMAT_NULL_STRING;
+
+		if (InString != nullptr)
+		{
+			if (InCapacity - Length < sizeof(ULONG))
+				return FALSE;
+
+			auto const Available = (SIZE_T) (InCapacity - Length - sizeof(ULONG));
+			ByteLength = (ULONG) ((InByteLength <= Available ? InByteLength : Available) & ~(InCharacterSize - 1));
+		}
+
+		if (!Append(&ByteLength, sizeof(ByteLength)))
+			return FALSE;
+
+		return InString == nullptr || Append(InString, ByteLength);
+	};
+
+	for (auto* Cursor = InFormat; *Cursor != L'\0'; )
+	{
+		if (*Cursor++ != L'%')
+			continue;
+
+		LOG_FORMAT_SPEC Spec;
+		Cursor = LogFormatParseSpec(Cursor, &Spec);
+
+		if (Spec.ArgumentType == LOG_FORMAT_ARGUMENT_INVALID)
+			return FALSE;
+
+		if (Spec.ArgumentType == LOG_FORMAT_ARGUMENT_NONE)
+			continue;
+
+		// 
+		// Read the width and the precision specified as arguments.
+		// 
+
+		if (Spec.IsWidthArgument)
+		{
+			INT32 Width = va_arg(InArguments, INT32);
+
+			if (!Append(&Width, sizeof(Width)))
+				return FALSE;
+		}
+
+		if (Spec.IsPrecisionArgument)
+		{
+			INT32 Precision = va_arg(InArguments, INT32);
+
+			if (!Append(&Precision, sizeof(Precision)))
+				return FALSE;
+
+			Spec.Precision = Precision < 0 ? -1 : Precision;
+		}
+
+		// 
+		// Read the argument itself.
+		// 
+
+		BOOLEAN WasAppended = FALSE;
+
+		switch (Spec.ArgumentType)
+		{
+			case LOG_FORMAT_ARGUMENT_INT32:
+			{
+				INT32 Value = va_arg(InArguments, INT32);
+				WasAppended = Append(&Value, sizeof(Value));
+				break;
+			}
+
+			case LOG_FORMAT_ARGUMENT_INT64:
+			{
+				LONG64 Value = va_arg(InArguments, LONG64);
+				WasAppended = Append(&Value, sizeof(Value));
+				break;
+			}
+
+			case LOG_FORMAT_ARGUMENT_POINTER:
+			{
+				ULONG64 Value = (ULONG_PTR) va_arg(InArguments, PVOID);
+				WasAppended = Append(&Value, sizeof(Value));
+				break;
+			}
+
+			case LOG_FORMAT_ARGUMENT_DOUBLE:
+			{
+				double Value = va_arg(InArguments, double);
+				WasAppended = Append(&Value, sizeof(Value));
+				break;
+			}
+
+			case LOG_FORMAT_ARGUMENT_STRING:
+			{
+				auto* Value = va_arg(InArguments, CONST VOID*);
+				SIZE_T NumberOfCharacters = 0;
+
+				if (Value != nullptr)
+				{
+					// 
+					// Never read past the precision, the string may not be null-terminated.
+					// 
+
+					auto const MaximumCharacters = Spec.Precision >= 0 ? (SIZE_T) Spec.Precision : MAXSIZE_T;
+
+					if (Spec.IsWide)
+						while (NumberOfCharacters < MaximumCharacters && ((CONST WCHAR*) Value)[NumberOfCharacters] != L'\0') ++NumberOfCharacters;
+					else
+						while (NumberOfCharacters < MaximumCharacters && ((CONST CHAR*) Value)[NumberOfCharacters] != '\0') ++NumberOfCharacters;
+				}
+
+				auto const CharacterSize = Spec.IsWide ? sizeof(WCHAR) : sizeof(CHAR);
+				WasAppended = AppendString(Value, NumberOfCharacters * CharacterSize, CharacterSize);
+				break;
+			}
+
+			case LOG_FORMAT_ARGUMENT_COUNTED_STRING:
+			{
+				auto* Value = va_arg(InArguments, CONST LOG_FORMAT_COUNTED_STRING*);
+				auto const CharacterSize = Spec.IsWide ? sizeof(WCHAR) : sizeof(CHAR);
+
+				if (Value == nullptr || Value->Buffer == nullptr)
+					WasAppended = AppendString(nullptr, 0, CharacterSize);
+				else
+					WasAppended = AppendString(Value->Buffer, Value->Length, CharacterSize);
+
+				break;
+			}
+		}
+
+		if (!WasAppended)
+			return FALSE;
+	}
+
+	*OutLength = Length;
+	return TRUE;
+}
+
+/// <summary>
+/// Renders a message from its format string and its encoded arguments.
+/// The output is truncated if it does not fit in the output buffer, and is always null-terminated.
+/// </summary>
+/// <param name="InFormat">The format string.</param>
+/// <param name="InArguments">The encoded arguments.</param>
+/// <param name="InArgumentsLength">The size of the encoded arguments, in bytes.</param>
+/// <param name="OutBuffer">The buffer receiving the message.</param>
+/// <param name="InCapacity">The size of the output buffer, in characters.</param>
+/// <returns>The number of characters written to the output buffer, without the null-terminator.</returns>
+inline SIZE_T LogFormatRender(CONST WCHAR* InFormat, CONST UCHAR* InArguments, SIZE_T InArgumentsLength, WCHAR* OutBuffer, SIZE_T InCapacity)
+{
+	if (InCapacity == 0)
+		return 0;
+
+	SIZE_T Written = 0;
+	SIZE_T Read = 0;
+	BOOLEAN IsTruncated = FALSE;
+
+	auto Emit = [&] (CONST WCHAR* InText, SIZE_T InLength)
+	{
+		if (InLength > InCapacity - 1 - Written)
+		{
+			InLength = InCapacity - 1 - Written;
+			IsTruncated = TRUE;
+		}
+
+		RtlCopyMemory(OutBuffer + Written, InText, InLength * sizeof(WCHAR));
+		Written += InLength;
+	};
+
+	auto Fetch = [&] (VOID* OutValue, SIZE_T InSize) -> BOOLEAN
+	{
+		if (InArgumentsLength - Read < InSize)
+			return FALSE;
+
+		RtlCopyMemory(OutValue, InArguments + Read, InSize);
+		Read += InSize;
+		return TRUE;
+	};
+
+	auto Print = [&] (CONST WCHAR* InSpec, auto InValue)
+	{
+		auto const Remaining = InCapacity - 1 - Written;
+		auto const Result = _snwprintf(OutBuffer + Written, Remaining, InSpec, InValue);
+
+		if (Result < 0 || (SIZE_T) Result > Remaining)
+		{
+			Written = InCapacity - 1;
+			IsTruncated = TRUE;
+		}
+		else
+		{
+			Written += Result;
+		}
+	};
+
+	auto AppendNumber = [] (WCHAR* InBuffer, ULONG& InIndex, ULONG InValue)
+	{
+		WCHAR Digits[10];
+		ULONG NumberOfDigits = 0;
+
+		do
+		{
+			Digits[NumberOfDigits++] = (WCHAR) (L'0' + (InValue % 10));
+			InValue /= 10;
+		}
+		while (InValue != 0);
+
+		while (NumberOfDigits != 0)
+			InBuffer[InIndex++] = Digits[--NumberOfDigits];
+	};
+
+	for (auto* Cursor = InFormat; *Cursor != L'\0' && !IsTruncated; )
+	{
+		// 
+		// Copy the literal text up to the next conversion.
+		// 
+
+		auto* Literal = Cursor;
+
+		while (*Cursor != L'\0' && *Cursor != L'%')
+			++Cursor;
+
+		Emit(Literal, Cursor - Literal);
+
+		if (*Cursor == L'\0' || IsTruncated)
+			break;
+
+		LOG_FORMAT_SPEC Spec;
+		Cursor = LogFormatParseSpec(Cursor + 1, &Spec);
+
+		if (Spec.ArgumentType == LOG_FORMAT_ARGUMENT_INVALID)
+			break;
+
+		if (Spec.ArgumentType == LOG_FORMAT_ARGUMENT_NONE)
+		{
+			Emit(&Spec.Conversion, 1);
+			continue;
+		}
+
+		// 
+		// Resolve the width and the precision specified as arguments.
+		// 
+
+		BOOLEAN IsLeftAligned = FALSE;
+
+		if (Spec.IsWidthArgument)
+		{
+			INT32 Width;
+
+			if (!Fetch(&Width, sizeof(Width)))
+				break;
+
+			IsLeftAligned = Width < 0;
+			Spec.Width = (Width < 0) ? -Width : Width;
+		}
+
+		if (Spec.IsPrecisionArgument)
+		{
+			INT32 Precision;
+
+			if (!Fetch(&Precision, sizeof(Precision)))
+				break;
+
+			Spec.Precision = (Precision < 0) ? -1 : Precision;
+		}
+
+		// 
+		// Rebuild a specification which only consumes a single argument, of a well-known size.
+		// 
+
+		WCHAR SingleSpec[48];
+		ULONG SpecLength = 0;
+
+		SingleSpec[SpecLength++] = L'%';
+
+		for (ULONG FlagIdx = 0; FlagIdx < Spec.NumberOfFlags; ++FlagIdx)
+			SingleSpec[SpecLength++] = Spec.Flags[FlagIdx];
+
+		if (IsLeftAligned)
+			SingleSpec[SpecLength++] = L'-';
+
+		if (Spec.Width >= 0)
+			AppendNumber(SingleSpec, SpecLength, (ULONG) Spec.Width);
+
+		auto const TerminateSpec = [&] (CONST CHAR* InModifier)
+		{
+			while (*InModifier != '\0')
+				SingleSpec[SpecLength++] = (WCHAR) *InModifier++;
+
+			SingleSpec[SpecLength++] = Spec.Conversion;
+			SingleSpec[SpecLength] = L'\0';
+		};
+
+		if (Spec.ArgumentType == LOG_FORMAT_ARGUMENT_STRING ||
+			Spec.ArgumentType == LOG_FORMAT_ARGUMENT_COUNTED_STRING)
+		{
+			ULONG ByteLength;
+
+			if (!Fetch(&ByteLength, sizeof(ByteLength)))
+				break;
+
+			if (ByteLength == LOG_FORMAT_NULL_STRING)
+			{
+				static CONST WCHAR NullString[] = { L'(', L'n', L'u', L'l', L'l', L')' };
+				Emit(NullString, ARRAYSIZE(NullString));
+				continue;
+			}
+
+			if (InArgumentsLength - Read < ByteLength)
+				break;
+
+			// 
+			// The encoded strings are not null-terminated, always bound them with a precision.
+			// 
+
+			auto const NumberOfCharacters = (ULONG) (ByteLength / (Spec.IsWide ? sizeof(WCHAR) : sizeof(CHAR)));
+			auto const Precision = (Spec.Precision >= 0 && (ULONG) Spec.Precision < NumberOfCharacters) ? (ULONG) Spec.Precision : NumberOfCharacters;
+
+			SingleSpec[SpecLength++] = L'.';
+			AppendNumber(SingleSpec, SpecLength, Precision);
+			TerminateSpec(Spec.IsWide ? "l" : "h");
+			Print(SingleSpec, (CONST VOID*) (InArguments + Read));
+			Read += ByteLength;
+			continue;
+		}
+
+		if (Spec.Precision >= 0)
+		{
+			SingleSpec[SpecLength++] = L'.';
+			AppendNumber(SingleSpec, SpecLength, (ULONG) Spec.Precision);
+		}
+
+		BOOLEAN WasFetched = FALSE;
+
+		switch (Spec.ArgumentType)
+		{
+			case LOG_FORMAT_ARGUMENT_INT32:
+			{
+				INT32 Value;
+
+				if ((WasFetched = Fetch(&Value, sizeof(Value))) != FALSE)
+				{
+					TerminateSpec(Spec.Conversion != L'c' ? "" : Spec.IsWide ? "l" : "h");
+					Print(SingleSpec, Value);
+				}
+
+				break;
+			}
+
+			case LOG_FORMAT_ARGUMENT_INT64:
+			{
+				LONG64 Value;
+
+				if ((WasFetched = Fetch(&Value, sizeof(Value))) != FALSE)
+				{
+					TerminateSpec("ll");
+					Print(SingleSpec, Value);
+				}
+
+				break;
+			}
+
+			case LOG_FORMAT_ARGUMENT_POINTER:
+			{
+				ULONG64 Value;
+
+				if ((WasFetched = Fetch(&Value, sizeof(Value))) != FALSE)
+				{
+					TerminateSpec("");
+					Print(SingleSpec, (PVOID) (ULONG_PTR) Value);
+				}
+
+				break;
+			}
+
+			case LOG_FORMAT_ARGUMENT_DOUBLE:
+			{
+				double Value;
+
+				if ((WasFetched = Fetch(&Value, sizeof(Value))) != FALSE)
+				{
+					TerminateSpec("");
+					Print(SingleSpec, Value);
+				}
+
+				break;
+			}
+		}
+
+		if (!WasFetched)
+			break;
+	}
+
+	OutBuffer[Written] = L'\0';
+	return Written;
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+// 
+// Rendering of binary payloads as hexadecimal dumps, sixteen bytes per line.
+// 
+//     00000000  4D 5A 90 00 03 00 00 00  04 00 00 00 FF FF 00 00  |MZ..............|
+// 
+// Payloads are rendered a bounded chunk of lines at a time, so dumping a payload never requires a buffer
+// proportional to its size. Every byte is rendered from a precomputed table of digit pairs.
+// 
+// This header only depends on the basic Windows types, so it can be included by a user-mode agent after <windows.h>.
+// 
+
+#define LOG_HEX_DUMP_BYTES_PER_LINE 16
+#define LOG_HEX_DUMP_LINES_PER_CHUNK 16
+#define LOG_HEX_DUMP_BYTES_PER_CHUNK (LOG_HEX_DUMP_BYTES_PER_LINE * LOG_HEX_DUMP_LINES_PER_CHUNK)
+
+// 
+// The longest line: a 64-bits offset, the hexadecimal and printable columns, and the break-line.
+// 
+
+#define LOG_HEX_DUMP_MAXIMUM_LINE_LENGTH (16 + 2 + LOG_HEX_DUMP_BYTES_PER_LINE * 3 + 1 + 1 + 1 + LOG_HEX_DUMP_BYTES_PER_LINE + 1 + 1)
+#define LOG_HEX_DUMP_MAXIMUM_CHUNK_LENGTH (LOG_HEX_DUMP_MAXIMUM_LINE_LENGTH * LOG_HEX_DUMP_LINES_PER_CHUNK)
+
+/// <summary>
+/// The hexadecimal digits of every byte value.
+/// </summary>
+typedef struct _LOG_HEX_DUMP_TABLE
+{
+	WCHAR Digits[256][2];
+} LOG_HEX_DUMP_TABLE;
+
+/// <summary>
+/// Computes the hexadecimal digits of every byte value.
+/// </summary>
+constexpr LOG_HEX_DUMP_TABLE LogHexDumpMakeTable()
+{
+	constexpr WCHAR HexDigits[] = L"0123456789ABCDEF";
+	LOG_HEX_DUMP_TABLE Table = { };
+
+	for (ULONG Value = 0; Value < 256; ++Value)
+	{
+		Table.Digits[Value][0] = HexDigits[Value >> 4];
+		Table.Digits[Value][1] = HexDigits[Value & 0xF];
+	}
+
+	return Table;
+}
+
+/// <summary>
+/// The hexadecimal digits of every byte value, computed at compile-time.
+/// </summary>
+inline constexpr LOG_HEX_DUMP_TABLE LogHexDumpTable = LogHexDumpMakeTable();
+
+/// <summary>
+/// Renders a single line of a hexadecimal dump, followed by a break-line.
+/// </summary>
+/// <param name="InBytes">The bytes of the line.</param>
+/// <param name="InLength">The number of bytes of the line, up to LOG_HEX_DUMP_BYTES_PER_LINE.</param>
+/// <param name="InOffset">The offset of the line in the payload.</param>
+/// <param name="InIsWideOffset">Whether the offset is rendered on 64-bits instead of 32-bits.</param>
+/// <param name="OutLine">The output buffer, of at least LOG_HEX_DUMP_MAXIMUM_LINE_LENGTH characters.</param>
+/// <returns>The number of characters written to the output buffer.</returns>
+inline SIZE_T LogHexDumpRenderLine(CONST UCHAR* InBytes, SIZE_T InLength, ULONG64 InOffset, BOOLEAN InIsWideOffset, WCHAR* OutLine)
+{
+	auto* Cursor = OutLine;
+
+	// 
+	// Render the offset, a byte at a time, from the most significant one.
+	// 
+
+	for (LONG Shift = InIsWideOffset ? 56 : 24; Shift >= 0; Shift -= 8)
+	{
+		auto const& Digits = LogHexDumpTable.Digits[(UCHAR) (InOffset >> Shift)];
+		*Cursor++ = Digits[0];
+		*Cursor++ = Digits[1];
+	}
+
+	*Cursor++ = L' ';
+
+	// 
+	// Render the hexadecimal column, padded with spaces on the last line.
+	// 
+
+	for (SIZE_T ByteIdx = 0; ByteIdx < LOG_HEX_DUMP_BYTES_PER_LINE; ++ByteIdx)
+	{
+		*Cursor++ = L' ';
+
+		if (ByteIdx == LOG_HEX_DUMP_BYTES_PER_LINE / 2)
+			*Cursor++ = L' ';
+
+		if (ByteIdx < InLength)
+		{
+			auto const& Digits = LogHexDumpTable.Digits[InBytes[ByteIdx]];
+			*Cursor++ = Digits[0];
+			*Cursor++ = Digits[1];
+		}
+		else
+		{
+			*Cursor++ = L' ';
+			*Cursor++ = L' ';
+		}
+	}
+
+	// 
+	// Render the printable column.
+	// 
+
+	*Cursor++ = L' ';
+	*Cursor++ = L' ';
+	*Cursor++ = L'|';
+
+	for (SIZE_T ByteIdx = 0; ByteIdx < InLength; ++ByteIdx)
+		*Cursor++ = (InBytes[ByteIdx] >= 0x20 && InBytes[ByteIdx] < 0x7F) ? (WCHAR) InBytes[ByteIdx] : L'.';
+
+	*Cursor++ = L'|';
+	*Cursor++ = L'\n';
+
+	return (SIZE_T) (Cursor - OutLine);
+}
+
+/// <summary>
+/// Renders a chunk of up to LOG_HEX_DUMP_BYTES_PER_CHUNK bytes of a hexadecimal dump, followed by a null-terminator.
+/// </summary>
+/// <param name="InBytes">The bytes of the chunk.</param>
+/// <param name="InLength">The number of bytes of the chunk, up to LOG_HEX_DUMP_BYTES_PER_CHUNK.</param>
+/// <param name="InOffset">The offset of the chunk in the payload.</param>
+/// <param name="InIsWideOffset">Whether the offsets are rendered on 64-bits instead of 32-bits.</param>
+/// <param name="OutBuffer">The output buffer, of at least LOG_HEX_DUMP_MAXIMUM_CHUNK_LENGTH + 1 characters.</param>
+/// <returns>The number of characters written to the output buffer, without the null-terminator.</returns>
+inline SIZE_T LogHexDumpRenderChunk(CONST UCHAR* InBytes, SIZE_T InLength, ULONG64 InOffset, BOOLEAN InIsWideOffset, WCHAR* OutBuffer)
+{
+	SIZE_T Written = 0;
+
+	for (SIZE_T LineOffset = 0; LineOffset < InLength; LineOffset += LOG_HEX_DUMP_BYTES_PER_LINE)
+	{
+		auto const LineLength = InLength - LineOffset < LOG_HEX_DUMP_BYTES_PER_LINE ? InLength - LineOffset : LOG_HEX_DUMP_BYTES_PER_LINE;
+		Written += LogHexDumpRenderLine(InBytes + LineOffset, LineLength, InOffset + LineOffset, InIsWideOffset, OutBuffer + Written);
+	}
+
+	OutBuffer[Written] = L'\0';
+	return Written;
+}
@@ -6,14 +6,90 @@
 __interface ILogProvider
 {
 	/// <summary>
-	/// Logs a message of the specified severity.
+	/// Logs a record, made of its header and its message.
 	/// </summary>
-	/// <param name="InLogLevel">The severity.</param>
-	/// <param name="InMessage">The message.</param>
-	void Log(ELogLevel InLogLevel, CONST WCHAR* InMessage);
+	/// <param name="InRecord">The record.</param>
+	void Log(CONST LogRecord& InRecord);
 
 	/// <summary>
 	/// Destroys this log provider.
 	/// </summary>
 	void Exit();
-};
\ No newline at end of file
+};
+
+/// <summary>
+/// The base interface of the logging providers receiving the messages unformatted, on the processor they are logged from.
+/// Messages are delivered without any lock held by the logger, so every processor may call the provider at the same time,
+/// except while they are kept in the early buffer. The early messages are replayed to the provider when it is added, already
+/// formatted, on the processor adding it.
+/// </summary>
+__interface ILogEventProvider
+{
+	/// <summary>
+	/// Logs a message, at an IRQL lower or equal to DISPATCH_LEVEL.
+	/// </summary>
+	/// <param name="InLevel">The severity.</param>
+	/// <param name="InFormat">The format of the message, which does not outlive the call.</param>
+	/// <param name="InArguments">The arguments for the message format.</param>
+	void LogEvent(ELogLevel InLevel, CONST WCHAR* InFormat, va_list InArguments);
+
+	/// <summary>
+	/// Destroys this log provider.
+	/// </summary>
+	void Exit();
+};
+
+/// <summary>
+/// The number of characters converted to ANSI at once by the providers.
+/// Chunks of this size fit in the 512 bytes DbgPrint buffer with the longest header, even when every character is converted to two bytes.
+/// </summary>
+#define LOG_PROVIDER_ANSI_CHUNK_LENGTH 220
+
+static_assert(LOG_RECORD_MAXIMUM_HEADER_LENGTH + LOG_PROVIDER_ANSI_CHUNK_LENGTH * 2 + 1 <= 512, "The ANSI chunks must fit in the DbgPrint buffer with the longest header");
+
+/// <summary>
+/// Converts a record to ANSI in chunks of bounded size, so messages of any length can be converted without allocating.
+/// The header is placed at the beginning of the first chunk, so every chunk can be emitted with a single write.
+/// </summary>
+/// <param name="InRecord">The record.</param>
+/// <param name="InCallback">The callback receiving every null-terminated chunk, and its length in bytes, returning FALSE to stop.</param>
+/// <returns>FALSE if a chunk could not be converted, or if the callback stopped the conversion.</returns>
+template <class TCallback>
+BOOLEAN LogProviderConvertToAnsi(CONST LogRecord& InRecord, TCallback InCallback)
+{
+	CHAR ChunkBuffer[LOG_RECORD_MAXIMUM_HEADER_LENGTH + LOG_PROVIDER_ANSI_CHUNK_LENGTH * 2 + 1];
+
+	RtlCopyMemory(ChunkBuffer, InRecord.Header, InRecord.HeaderLength);
+	auto HeaderLength = InRecord.HeaderLength;
+
+	auto* Message = InRecord.Message;
+
+	for (auto RemainingLength = InRecord.MessageLength; RemainingLength != 0; )
+	{
+		auto const ChunkLength = RemainingLength < LOG_PROVIDER_ANSI_CHUNK_LENGTH ? RemainingLength : LOG_PROVIDER_ANSI_CHUNK_LENGTH;
+
+		UNICODE_STRING UnicodeChunk;
+		UnicodeChunk.Buffer = (PWCH) Message;
+		UnicodeChunk.Length = (USHORT) (ChunkLength * sizeof(WCHAR));
+		UnicodeChunk.MaximumLength = UnicodeChunk.Length;
+
+		ANSI_STRING AnsiChunk;
+		AnsiChunk.Buffer = &ChunkBuffer[HeaderLength];
+		AnsiChunk.Length = 0;
+		AnsiChunk.MaximumLength = (USHORT) (sizeof(ChunkBuffer) - HeaderLength - 1);
+
+		if (!NT_SUCCESS(RtlUnicodeStringToAnsiString(&AnsiChunk, &UnicodeChunk, FALSE)))
+			return FALSE;
+
+		ChunkBuffer[HeaderLength + AnsiChunk.Length] = '\0';
+
+		if (!InCallback(ChunkBuffer, HeaderLength + AnsiChunk.Length))
+			return FALSE;
+
+		HeaderLength = 0;
+		Message += ChunkLength;
+		RemainingLength -= ChunkLength;
+	}
+
+	return TRUE;
+}
\ No newline at end of file
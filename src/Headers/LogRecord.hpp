@@ -0,0 +1,152 @@
+#pragma once
+
+// 
+// The records delivered to the logging providers.
+// 
+// The header of a record is rendered once by the logger, whatever the number of providers, and is handed to them
+// next to the message as a header and body pair: providers emit both without having to copy or re-render either.
+// 
+//     [2026-10-18 14:03:27.512] [CPU 3]  INF  : The message.
+// 
+
+#define LOG_RECORD_LEVEL_TAG_LENGTH 9
+#define LOG_RECORD_MAXIMUM_HEADER_LENGTH 64
+
+/// <summary>
+/// The tag of every level of severity, indexed by their value, the last one being used for unknown levels.
+/// </summary>
+inline constexpr CHAR LogRecordLevelTags[][LOG_RECORD_LEVEL_TAG_LENGTH + 1] =
+{
+	" TRACE : ",
+	" DEBUG : ",
+	"  INF  : ",
+	"  WRN  : ",
+	" ERROR : ",
+	" FATAL : ",
+	"  UNK  : ",
+};
+
+/// <summary>
+/// A record delivered to the logging providers.
+/// </summary>
+struct LogRecord
+{
+	/// <summary>
+	/// The severity.
+	/// </summary>
+	ELogLevel Level;
+
+	/// <summary>
+	/// The system time the message was logged at.
+	/// </summary>
+	LARGE_INTEGER Timestamp;
+
+	/// <summary>
+	/// The index of the processor the message was logged from.
+	/// </summary>
+	ULONG ProcessorIndex;
+
+	/// <summary>
+	/// The sequence number of the record, incremented for every record delivered by the logger.
+	/// </summary>
+	ULONG64 Sequence;
+
+	/// <summary>
+	/// The header of the record, in ANSI, null-terminated.
+	/// </summary>
+	CONST CHAR* Header;
+
+	/// <summary>
+	/// The number of characters of the header.
+	/// </summary>
+	SIZE_T HeaderLength;
+
+	/// <summary>
+	/// The message, ending with a break-line, null-terminated.
+	/// </summary>
+	CONST WCHAR* Message;
+
+	/// <summary>
+	/// The number of characters of the message, including the break-line.
+	/// </summary>
+	SIZE_T MessageLength;
+};
+
+/// <summary>
+/// Writes a number with a fixed number of digits.
+/// </summary>
+/// <param name="InOutCursor">The output cursor, advanced past the digits.</param>
+/// <param name="InValue">The number.</param>
+/// <param name="InNumberOfDigits">The number of digits, the number being padded with zeros.</param>
+inline void LogRecordWriteDigits(CHAR*& InOutCursor, ULONG InValue, ULONG InNumberOfDigits)
+{
+	for (ULONG DigitIdx = InNumberOfDigits; DigitIdx != 0; --DigitIdx)
+	{
+		InOutCursor[DigitIdx - 1] = (CHAR) ('0' + InValue % 10);
+		InValue /= 10;
+	}
+
+	InOutCursor += InNumberOfDigits;
+}
+
+/// <summary>
+/// Renders the header of a record.
+/// </summary>
+/// <param name="OutHeader">The output buffer, of at least LOG_RECORD_MAXIMUM_HEADER_LENGTH characters.</param>
+/// <param name="InLevel">The severity.</param>
+/// <param name="InTime">The time of the record, or nullptr to omit it.</param>
+/// <param name="InProcessorIndex">The index of the processor the record was logged from, or MAXULONG to omit it.</param>
+/// <returns>The number of characters written to the output buffer, without the null-terminator.</returns>
+inline SIZE_T LogRecordRenderHeader(CHAR* OutHeader, ELogLevel InLevel, OPTIONAL CONST TIME_FIELDS* InTime, ULONG InProcessorIndex)
+{
+	auto* Cursor = OutHeader;
+
+	if (InTime != nullptr)
+	{
+		*Cursor++ = '[';
+		LogRecordWriteDigits(Cursor, (ULONG) InTime->Year, 4);
+		*Cursor++ = '-';
+		LogRecordWriteDigits(Cursor, (ULONG) InTime->Month, 2);
+		*Cursor++ = '-';
+		LogRecordWriteDigits(Cursor, (ULONG) InTime->Day, 2);
+		*Cursor++ = ' ';
+		LogRecordWriteDigits(Cursor, (ULONG) InTime->Hour, 2);
+		*Cursor++ = ':';
+		LogRecordWriteDigits(Cursor, (ULONG) InTime->Minute, 2);
+		*Cursor++ = ':';
+		LogRecordWriteDigits(Cursor, (ULONG) InTime->Second, 2);
+		*Cursor++ = '.';
+		LogRecordWriteDigits(Cursor, (ULONG) InTime->Milliseconds, 3);
+		*Cursor++ = ']';
+		*Cursor++ = ' ';
+	}
+
+	if (InProcessorIndex != MAXULONG)
+	{
+		ULONG NumberOfDigits = 1;
+
+		for (auto Value = InProcessorIndex; Value >= 10; Value /= 10)
+			NumberOfDigits++;
+
+		*Cursor++ = '[';
+		*Cursor++ = 'C';
+		*Cursor++ = 'P';
+		*Cursor++ = 'U';
+		*Cursor++ = ' ';
+		LogRecordWriteDigits(Cursor, InProcessorIndex, NumberOfDigits);
+		*Cursor++ = ']';
+		*Cursor++ = ' ';
+	}
+
+	// 
+	// Copy the tag of the level from the table.
+	// 
+
+	auto const LevelIdx = (ULONG) InLevel < ARRAYSIZE(LogRecordLevelTags) - 1 ? (ULONG) InLevel : ARRAYSIZE(LogRecordLevelTags) - 1;
+
+	for (ULONG CharacterIdx = 0; CharacterIdx < LOG_RECORD_LEVEL_TAG_LENGTH; ++CharacterIdx)
+		*Cursor++ = LogRecordLevelTags[LevelIdx][CharacterIdx];
+
+	*Cursor = '\0';
+	return (SIZE_T) (Cursor - OutHeader);
+}
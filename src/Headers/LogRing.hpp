@@ -0,0 +1,443 @@
+#pragma once
+
+// 
+// Prevents the protection of a view from being changed, so a consumer cannot make its view of the ring writable.
+// 
+
+#ifndef SEC_NO_CHANGE
+#define SEC_NO_CHANGE 0x00400000
+#endif
+
+/// <summary>
+/// A ring of log records stored in a section locked in memory, whose views can be mapped read-only into user-mode processes.
+/// The memory layout is described in LogRingLayout.h.
+/// </summary>
+class LogRing
+{
+private:
+
+	/// <summary>
+	/// An entry of the index of the format strings already interned in the string table.
+	/// </summary>
+	struct LogRingIndexEntry
+	{
+		/// <summary>
+		/// The address of the format string.
+		/// </summary>
+		CONST WCHAR* Format;
+
+		/// <summary>
+		/// The identifier of the format string in the string table.
+		/// </summary>
+		ULONG StringId;
+	};
+
+	/// <summary>
+	/// The number of entries in the index of the interned format strings, must be a power of two.
+	/// </summary>
+	static constexpr ULONG IndexCapacity = 1024;
+
+	/// <summary>
+	/// The maximum number of characters of a format string which can be interned.
+	/// </summary>
+	static constexpr SIZE_T MaximumFormatLength = 1024;
+
+private:
+
+	/// <summary>
+	/// The handle to the section backing the ring, which the views of the consumers are mapped from.
+	/// </summary>
+	HANDLE SectionHandle = nullptr;
+
+	/// <summary>
+	/// The section backing the ring.
+	/// </summary>
+	PVOID SectionObject = nullptr;
+
+	/// <summary>
+	/// The memory descriptor list locking the view of the section in system space, so it can be written to at any IRQL.
+	/// </summary>
+	PMDL Mdl = nullptr;
+
+	/// <summary>
+	/// The header of the ring, mapped in system space.
+	/// </summary>
+	LOG_RING_HEADER* Header = nullptr;
+
+	/// <summary>
+	/// The state of the producer, pointing to the data area and to the string table mapped in system space.
+	/// </summary>
+	LOG_RING_PRODUCER Producer = { };
+
+	/// <summary>
+	/// The index of the format strings already interned, keyed by their address and checked against their contents.
+	/// </summary>
+	LogRingIndexEntry Index[IndexCapacity] = { };
+
+	/// <summary>
+	/// The number of format strings already interned.
+	/// </summary>
+	ULONG NumberOfStrings = 0;
+
+	/// <summary>
+	/// The buffer used to encode the arguments of a message.
+	/// </summary>
+	UCHAR ArgumentsBuffer[2048] = { };
+
+	/// <summary>
+	/// The buffer used to format the messages which cannot be encoded.
+	/// </summary>
+	WCHAR TextBuffer[1024] = { };
+
+public:
+
+	/// <summary>
+	/// Allocates the memory of the ring.
+	/// Must be called at PASSIVE_LEVEL.
+	/// </summary>
+	/// <param name="InDataSize">The size of the data area, rounded up to a power of two.</param>
+	/// <param name="InStringTableSize">The size of the string table.</param>
+	NTSTATUS Init(ULONG InDataSize, ULONG InStringTableSize)
+	{
+		if (this->SectionHandle != nullptr)
+			return STATUS_ALREADY_INITIALIZED;
+
+		// 
+		// Round the size of the data area up to a power of two, and to at least 64 KB so any interned format string fits in a record.
+		// 
+
+		ULONG DataSize = 64 * 1024;
+
+		while (DataSize < InDataSize)
+		{
+			if (DataSize > (MAXULONG / 2))
+				return STATUS_INVALID_PARAMETER;
+
+			DataSize *= 2;
+		}
+
+		auto const HeaderSize = (SIZE_T) ROUND_TO_PAGES(sizeof(LOG_RING_HEADER));
+		auto const StringTableSize = (SIZE_T) ROUND_TO_PAGES(InStringTableSize);
+		auto SectionSize = HeaderSize + DataSize + StringTableSize;
+
+		if (SectionSize > MAXULONG)
+			return STATUS_INVALID_PARAMETER;
+
+		// 
+		// Create a section backed by the paging file, whose pages are zeroed so no kernel memory is ever exposed.
+		// The pages stay alive as long as a view of the section is mapped, even once the ring is released.
+		// 
+
+		LARGE_INTEGER MaximumSize;
+		MaximumSize.QuadPart = (LONGLONG) SectionSize;
+
+		OBJECT_ATTRIBUTES ObjectAttributes;
+		InitializeObjectAttributes(&ObjectAttributes, NULL, OBJ_KERNEL_HANDLE, NULL, NULL);
+
+		auto Status = ZwCreateSection(&this->SectionHandle, SECTION_ALL_ACCESS, &ObjectAttributes, &MaximumSize, PAGE_READWRITE, SEC_COMMIT, NULL);
+
+		if (!NT_SUCCESS(Status))
+		{
+			this->SectionHandle = nullptr;
+			return Status;
+		}
+
+		Status = ObReferenceObjectByHandle(this->SectionHandle, SECTION_ALL_ACCESS, NULL, KernelMode, &this->SectionObject, NULL);
+
+		if (!NT_SUCCESS(Status))
+		{
+			this->SectionObject = nullptr;
+			this->Exit();
+			return Status;
+		}
+
+		// 
+		// Map the section in system space, and lock its pages so the producer can write to them under a spin lock.
+		// 
+
+		PVOID Section = nullptr;
+		Status = MmMapViewInSystemSpace(this->SectionObject, &Section, &SectionSize);
+
+		if (!NT_SUCCESS(Status))
+		{
+			this->Exit();
+			return Status;
+		}
+
+		this->Header = (LOG_RING_HEADER*) Section;
+		this->Mdl = IoAllocateMdl(Section, (ULONG) SectionSize, FALSE, FALSE, NULL);
+
+		if (this->Mdl == nullptr)
+		{
+			this->Exit();
+			return STATUS_INSUFFICIENT_RESOURCES;
+		}
+
+		__try
+		{
+			MmProbeAndLockPages(this->Mdl, KernelMode, IoWriteAccess);
+		}
+		__except (EXCEPTION_EXECUTE_HANDLER)
+		{
+			IoFreeMdl(this->Mdl);
+			this->Mdl = nullptr;
+			this->Exit();
+			return STATUS_INSUFFICIENT_RESOURCES;
+		}
+
+		// 
+		// Describe the layout of the ring for the consumers.
+		// 
+
+		auto* SectionHeader = (LOG_RING_HEADER*) Section;
+		SectionHeader->Magic = LOG_RING_MAGIC;
+		SectionHeader->Version = LOG_RING_VERSION;
+		SectionHeader->HeaderSize = (ULONG) HeaderSize;
+		SectionHeader->DataSize = DataSize;
+		SectionHeader->StringTableOffset = (ULONG) (HeaderSize + DataSize);
+		SectionHeader->StringTableSize = (ULONG) StringTableSize;
+
+		LogRingProducerInit(&this->Producer, Section);
+		InterlockedExchangePointer((PVOID*) &this->Header, SectionHeader);
+		return STATUS_SUCCESS;
+	}
+
+	/// <summary>
+	/// Releases the ring.
+	/// The views mapped into user-mode processes stay valid, and the memory of the section is released along with the last of them.
+	/// Must be called at PASSIVE_LEVEL.
+	/// </summary>
+	void Exit()
+	{
+		if (this->Mdl != nullptr)
+		{
+			MmUnlockPages(this->Mdl);
+			IoFreeMdl(this->Mdl);
+		}
+
+		if (this->Header != nullptr)
+			MmUnmapViewInSystemSpace(this->Header);
+
+		if (this->SectionObject != nullptr)
+			ObDereferenceObject(this->SectionObject);
+
+		if (this->SectionHandle != nullptr)
+			ZwClose(this->SectionHandle);
+
+		this->SectionHandle = nullptr;
+		this->SectionObject = nullptr;
+		this->Mdl = nullptr;
+		this->Header = nullptr;
+		this->Producer = { };
+	}
+
+	/// <summary>
+	/// Maps a read-only view of the ring into the address space of the current process, whose protection cannot be changed.
+	/// Typically called from the device control handler of the driver, on behalf of the consumer.
+	/// The view is unmapped when the process exits; the driver should also unmap it from its IRP_MJ_CLEANUP handler, which
+	/// runs in the context of the consumer, so a consumer closing its handle to the device loses its view of the ring.
+	/// Must be called at PASSIVE_LEVEL.
+	/// </summary>
+	/// <param name="OutAddress">The user-mode address of the view.</param>
+	NTSTATUS MapIntoCurrentProcess(PVOID* OutAddress)
+	{
+		*OutAddress = nullptr;
+
+		if (this->SectionHandle == nullptr)
+			return STATUS_DEVICE_NOT_READY;
+
+		SIZE_T ViewSize = 0;
+		return ZwMapViewOfSection(this->SectionHandle, ZwCurrentProcess(), OutAddress, 0, 0, NULL, &ViewSize, ViewUnmap, SEC_NO_CHANGE, PAGE_READONLY);
+	}
+
+	/// <summary>
+	/// Removes a view of the ring from the address space of the current process, e.g. from the IRP_MJ_CLEANUP handler of the driver.
+	/// Can be called even after the ring was released.
+	/// Must be called at PASSIVE_LEVEL.
+	/// </summary>
+	/// <param name="InAddress">The user-mode address of the view.</param>
+	void UnmapFromCurrentProcess(PVOID InAddress)
+	{
+		if (InAddress != nullptr)
+			ZwUnmapViewOfSection(ZwCurrentProcess(), InAddress);
+	}
+
+	/// <summary>
+	/// Appends a text record to the ring.
+	/// Calls must be serialized by the caller, as the ring only supports a single producer.
+	/// </summary>
+	/// <param name="InLogLevel">The severity.</param>
+	/// <param name="InMessage">The message.</param>
+	/// <param name="InLength">The number of characters in the message.</param>
+	void Write(ELogLevel InLogLevel, CONST WCHAR* InMessage, SIZE_T InLength)
+	{
+		if (this->Header == nullptr)
+			return;
+
+		this->Append(LOG_RING_RECORD_TEXT, InLogLevel, this->Header->NextSequence, nullptr, 0, InMessage, InLength * sizeof(WCHAR));
+	}
+
+	/// <summary>
+	/// Appends an event record to the ring, referencing the interned format string and holding the encoded arguments.
+	/// Falls back to a text record if the message cannot be encoded.
+	/// Calls must be serialized by the caller, as the ring only supports a single producer.
+	/// </summary>
+	/// <param name="InLogLevel">The severity.</param>
+	/// <param name="InFormat">The format of the message.</param>
+	/// <param name="InArguments">The arguments for the message format.</param>
+	void WriteEvent(ELogLevel InLogLevel, CONST WCHAR* InFormat, va_list InArguments)
+	{
+		if (this->Header == nullptr)
+			return;
+
+		// 
+		// Encode the arguments, never more than what a single record can hold.
+		// 
+
+		auto const StringId = this->Intern(InFormat);
+
+		if (StringId != LOG_RING_INVALID_STRING)
+		{
+			auto ArgumentsCapacity = (ULONG) sizeof(this->ArgumentsBuffer);
+
+			auto const MaximumRecordSize = LogRingProducerGetMaximumRecordSize(&this->Producer);
+
+			if (MaximumRecordSize - sizeof(LOG_RING_RECORD) - sizeof(LOG_RING_EVENT) < ArgumentsCapacity)
+				ArgumentsCapacity = (ULONG) (MaximumRecordSize - sizeof(LOG_RING_RECORD) - sizeof(LOG_RING_EVENT));
+
+			va_list Arguments;
+			va_copy(Arguments, InArguments);
+
+			LOG_RING_EVENT Event = { };
+			Event.StringId = StringId;
+
+			auto const WasEncoded = LogFormatEncode(InFormat, Arguments, this->ArgumentsBuffer, ArgumentsCapacity, &Event.Length);
+			va_end(Arguments);
+
+			if (WasEncoded)
+			{
+				this->Append(LOG_RING_RECORD_EVENT, InLogLevel, this->Header->NextSequence, &Event, sizeof(Event), this->ArgumentsBuffer, Event.Length);
+				return;
+			}
+		}
+
+		// 
+		// Format the message as text instead.
+		// 
+
+		auto NumberOfCharacters = _vsnwprintf(this->TextBuffer, ARRAYSIZE(this->TextBuffer) - 1, InFormat, InArguments);
+
+		if (NumberOfCharacters < 0)
+			NumberOfCharacters = ARRAYSIZE(this->TextBuffer) - 1;
+
+		this->Write(InLogLevel, this->TextBuffer, NumberOfCharacters);
+	}
+
+private:
+
+	/// <summary>
+	/// Returns the identifier of a format string in the string table, and interns it if needed.
+	/// </summary>
+	/// <param name="InFormat">The format string.</param>
+	/// <returns>The identifier of the string, or LOG_RING_INVALID_STRING if it cannot be interned.</returns>
+	ULONG Intern(CONST WCHAR* InFormat)
+	{
+		// 
+		// Look the format string up by its address.
+		// 
+
+		auto const Hash = (ULONG) (((ULONG64) (ULONG_PTR) InFormat * 0x9E3779B97F4A7C15ull) >> 32);
+		auto Slot = Hash & (IndexCapacity - 1);
+
+		for (; this->Index[Slot].Format != nullptr; Slot = (Slot + 1) & (IndexCapacity - 1))
+		{
+			if (this->Index[Slot].Format != InFormat)
+				continue;
+
+			// 
+			// A format string which is not static may reuse the address of another one, also compare their contents.
+			// 
+
+			if (this->IsStringEqual(this->Index[Slot].StringId, InFormat))
+				return this->Index[Slot].StringId;
+
+			break;
+		}
+
+		// 
+		// Keep the index sparse enough for the probing to stay short, unless the entry of a reused address is replaced.
+		// 
+
+		auto const IsReplacing = this->Index[Slot].Format != nullptr;
+
+		if (!IsReplacing && this->NumberOfStrings >= (IndexCapacity / 4) * 3)
+			return LOG_RING_INVALID_STRING;
+
+		auto const NumberOfCharacters = wcsnlen(InFormat, MaximumFormatLength + 1);
+
+		if (NumberOfCharacters > MaximumFormatLength)
+			return LOG_RING_INVALID_STRING;
+
+		// 
+		// Append the format string to the string table, which also lets the consumers following the stream of records know about it.
+		// 
+
+		auto const StringId = LogRingProducerAddString(&this->Producer, InFormat, NumberOfCharacters, this->QueryTimestamp(), KeGetCurrentProcessorNumberEx(nullptr));
+
+		if (StringId == LOG_RING_INVALID_STRING)
+			return LOG_RING_INVALID_STRING;
+
+		this->Index[Slot].Format = InFormat;
+		this->Index[Slot].StringId = StringId;
+
+		if (!IsReplacing)
+			this->NumberOfStrings++;
+
+		return StringId;
+	}
+
+	/// <summary>
+	/// Whether a string of the string table is equal to a format string.
+	/// </summary>
+	/// <param name="InStringId">The identifier of the string.</param>
+	/// <param name="InFormat">The format string.</param>
+	BOOLEAN IsStringEqual(ULONG InStringId, CONST WCHAR* InFormat) CONST
+	{
+		auto const* Entry = (CONST LOG_RING_STRING*) (this->Producer.StringTable + (SIZE_T) InStringId * LOG_RING_ALIGNMENT);
+		auto const* Text = (CONST WCHAR*) (Entry + 1);
+
+		for (SIZE_T CharacterIdx = 0; ; ++CharacterIdx)
+		{
+			if (Text[CharacterIdx] != InFormat[CharacterIdx])
+				return FALSE;
+
+			if (Text[CharacterIdx] == L'\0')
+				return TRUE;
+		}
+	}
+
+	/// <summary>
+	/// Returns the current system time, in 100ns units.
+	/// </summary>
+	LONG64 QueryTimestamp() CONST
+	{
+		LARGE_INTEGER Timestamp;
+		KeQuerySystemTimePrecise(&Timestamp);
+		return Timestamp.QuadPart;
+	}
+
+	/// <summary>
+	/// Appends a record to the ring, stamped with the current time and processor.
+	/// </summary>
+	/// <param name="InType">The type of the record.</param>
+	/// <param name="InLogLevel">The severity.</param>
+	/// <param name="InSequence">The sequence number of the record, consumed if not negative.</param>
+	/// <param name="InPrefix">The prefix of the payload.</param>
+	/// <param name="InPrefixLength">The size of the prefix, in bytes.</param>
+	/// <param name="InPayload">The payload.</param>
+	/// <param name="InPayloadLength">The size of the payload, in bytes.</param>
+	void Append(USHORT InType, ELogLevel InLogLevel, LONG64 InSequence, CONST VOID* InPrefix, SIZE_T InPrefixLength, CONST VOID* InPayload, SIZE_T InPayloadLength)
+	{
+		LogRingProducerAppend(&this->Producer, InType, (USHORT) InLogLevel, InSequence, this->QueryTimestamp(), KeGetCurrentProcessorNumberEx(nullptr), InPrefix, InPrefixLength, InPayload, InPayloadLength);
+	}
+};
@@ -0,0 +1,601 @@
+#pragma once
+
+// 
+// Memory layout of the shared log ring, as seen by both the kernel-mode producer and the user-mode consumers.
+// 
+// The section starts with a LOG_RING_HEADER, followed by the data area at offset 'HeaderSize'.
+// The data area is 'DataSize' bytes long, which is always a power of two.
+// 
+// The producer never blocks: it keeps writing records and overwrites the oldest ones when the ring is full.
+// Every offset exposed in the header is a monotonic byte counter, its position in the data area is (Offset & (DataSize - 1)).
+// 
+//  - 'ReserveOffset' is published (with a full barrier) before the producer writes into the data area.
+//  - 'CommitOffset' is published (with release semantics) once the record has been entirely written.
+// 
+// A consumer maps the section read-only and keeps its own read offset. It reads a record directly from the mapping,
+// then re-reads 'ReserveOffset': if the producer reserved past (ReadOffset + DataSize), the record may have been
+// overwritten while it was being read, and must be discarded. Sequence numbers are contiguous across text and event
+// records, definition records have none, so a consumer that had to skip records knows exactly how many were lost.
+// 
+// Records are 8-bytes aligned and never wrap around the end of the data area; the producer writes a padding
+// record to fill the remaining space instead.
+// 
+// Messages are stored as event records: the format string is interned once in the string table, which follows the
+// data area at offset 'StringTableOffset' and is never overwritten, and the record only holds the identifier of the
+// string and the arguments, encoded as described in LogFormat.h. A definition record is also emitted in the ring the
+// first time a string is interned, for consumers which only follow the stream of records. The identifier of a string
+// is its offset in the string table, divided by LOG_RING_ALIGNMENT.
+// 
+// Messages whose format string or arguments cannot be encoded are stored as text records instead.
+// 
+// The arithmetic of the producer is also implemented here, without any allocation or kernel routine, so the driver and
+// the user-mode tests append their records with the exact same code.
+// 
+// This header only depends on the basic Windows types and interlocked intrinsics, so it can be included by a
+// user-mode agent after <windows.h>.
+// 
+
+#include "LogFormat.h"
+
+#define LOG_RING_MAGIC 0x474E524C
+#define LOG_RING_VERSION 2
+
+#define LOG_RING_RECORD_PADDING 0
+#define LOG_RING_RECORD_TEXT 1
+#define LOG_RING_RECORD_DEFINITION 2
+#define LOG_RING_RECORD_EVENT 3
+
+#define LOG_RING_INVALID_STRING MAXULONG
+
+#define LOG_RING_ALIGNMENT 8
+#define LOG_RING_ALIGN_UP(Size) (((Size) + (LOG_RING_ALIGNMENT - 1)) & ~((SIZE_T) LOG_RING_ALIGNMENT - 1))
+
+/// <summary>
+/// The header at the very beginning of the shared log ring.
+/// </summary>
+typedef struct _LOG_RING_HEADER
+{
+	/// <summary>
+	/// Always equal to LOG_RING_MAGIC.
+	/// </summary>
+	ULONG Magic;
+
+	/// <summary>
+	/// The version of this layout, always equal to LOG_RING_VERSION.
+	/// </summary>
+	ULONG Version;
+
+	/// <summary>
+	/// The offset of the data area, from the beginning of the section.
+	/// </summary>
+	ULONG HeaderSize;
+
+	/// <summary>
+	/// The size of the data area, always a power of two.
+	/// </summary>
+	ULONG DataSize;
+
+	/// <summary>
+	/// The offset of the string table, from the beginning of the section.
+	/// </summary>
+	ULONG StringTableOffset;
+
+	/// <summary>
+	/// The size of the string table.
+	/// </summary>
+	ULONG StringTableSize;
+
+	/// <summary>
+	/// The number of bytes the producer has reserved, and may be writing to.
+	/// </summary>
+	volatile LONG64 ReserveOffset;
+
+	/// <summary>
+	/// The number of bytes the producer has entirely written.
+	/// </summary>
+	volatile LONG64 CommitOffset;
+
+	/// <summary>
+	/// The sequence number that will be assigned to the next text or event record.
+	/// </summary>
+	volatile LONG64 NextSequence;
+
+	/// <summary>
+	/// The number of messages that had to be truncated to fit in the ring.
+	/// </summary>
+	volatile LONG64 TruncatedRecords;
+
+	/// <summary>
+	/// The number of bytes of the string table which have been entirely written.
+	/// </summary>
+	volatile LONG64 StringTableCommit;
+
+} LOG_RING_HEADER;
+
+/// <summary>
+/// The header of every record stored in the data area.
+/// </summary>
+typedef struct _LOG_RING_RECORD
+{
+	/// <summary>
+	/// The total size of this record, including this header and the alignment.
+	/// </summary>
+	ULONG Size;
+
+	/// <summary>
+	/// The type of this record, one of the LOG_RING_RECORD_* values.
+	/// </summary>
+	USHORT Type;
+
+	/// <summary>
+	/// The severity of the message, an ELogLevel.
+	/// </summary>
+	USHORT Level;
+
+	/// <summary>
+	/// The sequence number of this record, or -1 for definition records.
+	/// </summary>
+	LONG64 Sequence;
+
+	/// <summary>
+	/// The system time at which this record was logged, in 100ns units.
+	/// </summary>
+	LONG64 Timestamp;
+
+	/// <summary>
+	/// The index of the processor this record was logged on.
+	/// </summary>
+	ULONG ProcessorIndex;
+
+	/// <summary>
+	/// The size in bytes of the payload following this header.
+	/// For text records, the payload is a UTF-16 string which is not null-terminated.
+	/// For definition and event records, the payload starts with a LOG_RING_EVENT.
+	/// </summary>
+	ULONG PayloadLength;
+
+} LOG_RING_RECORD;
+
+static_assert(sizeof(LOG_RING_RECORD) % LOG_RING_ALIGNMENT == 0, "The log ring records must keep the alignment of the data area");
+
+/// <summary>
+/// The beginning of the payload of the definition and event records.
+/// </summary>
+typedef struct _LOG_RING_EVENT
+{
+	/// <summary>
+	/// The identifier of the format string in the string table.
+	/// </summary>
+	ULONG StringId;
+
+	/// <summary>
+	/// The size in bytes of the data following this structure.
+	/// For definition records, the data is the UTF-16 format string, which is not null-terminated.
+	/// For event records, the data are the encoded arguments of the format string.
+	/// </summary>
+	ULONG Length;
+
+} LOG_RING_EVENT;
+
+/// <summary>
+/// An entry of the string table.
+/// </summary>
+typedef struct _LOG_RING_STRING
+{
+	/// <summary>
+	/// The total size of this entry, including this header and the alignment.
+	/// </summary>
+	ULONG Size;
+
+	/// <summary>
+	/// The size in bytes of the UTF-16 string following this header, including its null-terminator.
+	/// </summary>
+	ULONG Length;
+
+} LOG_RING_STRING;
+
+/// <summary>
+/// The state of the producer of the shared log ring.
+/// </summary>
+typedef struct _LOG_RING_PRODUCER
+{
+	/// <summary>
+	/// The header of the section.
+	/// </summary>
+	LOG_RING_HEADER* Header;
+
+	/// <summary>
+	/// The data area of the section.
+	/// </summary>
+	UCHAR* Data;
+
+	/// <summary>
+	/// The string table of the section.
+	/// </summary>
+	UCHAR* StringTable;
+
+} LOG_RING_PRODUCER;
+
+/// <summary>
+/// Attaches the producer to a section whose header has already been described.
+/// </summary>
+/// <param name="OutProducer">The producer.</param>
+/// <param name="InSection">The base address of the section.</param>
+inline void LogRingProducerInit(LOG_RING_PRODUCER* OutProducer, VOID* InSection)
+{
+	OutProducer->Header = (LOG_RING_HEADER*) InSection;
+	OutProducer->Data = (UCHAR*) InSection + OutProducer->Header->HeaderSize;
+	OutProducer->StringTable = (UCHAR*) InSection + OutProducer->Header->StringTableOffset;
+}
+
+/// <summary>
+/// The maximum size of a record, a quarter of the data area.
+/// </summary>
+/// <param name="InProducer">The producer.</param>
+inline SIZE_T LogRingProducerGetMaximumRecordSize(CONST LOG_RING_PRODUCER* InProducer)
+{
+	return (SIZE_T) InProducer->Header->DataSize / 4;
+}
+
+/// <summary>
+/// Appends a record to the ring, made of an optional fixed-size prefix and of a payload which is truncated if needed.
+/// Calls must be serialized, as the ring only supports a single producer.
+/// </summary>
+/// <param name="InProducer">The producer.</param>
+/// <param name="InType">The type of the record.</param>
+/// <param name="InLevel">The severity, an ELogLevel.</param>
+/// <param name="InSequence">The sequence number of the record, consumed if not negative.</param>
+/// <param name="InTimestamp">The system time at which the record was logged.</param>
+/// <param name="InProcessorIndex">The index of the processor the record was logged on.</param>
+/// <param name="InPrefix">The prefix of the payload.</param>
+/// <param name="InPrefixLength">The size of the prefix, in bytes.</param>
+/// <param name="InPayload">The payload.</param>
+/// <param name="InPayloadLength">The size of the payload, in bytes.</param>
+inline void LogRingProducerAppend(LOG_RING_PRODUCER* InProducer, USHORT InType, USHORT InLevel, LONG64 InSequence, LONG64 InTimestamp, ULONG InProcessorIndex, CONST VOID* InPrefix, SIZE_T InPrefixLength, CONST VOID* InPayload, SIZE_T InPayloadLength)
+{
+	auto* RingHeader = InProducer->Header;
+
+	// 
+	// Truncate the payloads which cannot fit in a quarter of the ring.
+	// 
+
+	auto const DataSize = (SIZE_T) RingHeader->DataSize;
+	auto const MaximumPayloadLength = LogRingProducerGetMaximumRecordSize(InProducer) - sizeof(LOG_RING_RECORD) - InPrefixLength;
+
+	if (InPayloadLength > MaximumPayloadLength)
+	{
+		InPayloadLength = MaximumPayloadLength & ~((SIZE_T) sizeof(WCHAR) - 1);
+		InterlockedIncrement64(&RingHeader->TruncatedRecords);
+	}
+
+	auto const RecordSize = LOG_RING_ALIGN_UP(sizeof(LOG_RING_RECORD) + InPrefixLength + InPayloadLength);
+
+	// 
+	// Records never wrap around, fill the end of the data area with padding if needed.
+	// 
+
+	auto Offset = RingHeader->CommitOffset;
+	auto Position = (SIZE_T) Offset & (DataSize - 1);
+
+	if (DataSize - Position < RecordSize)
+	{
+		auto const PaddingSize = DataSize - Position;
+		InterlockedExchange64(&RingHeader->ReserveOffset, Offset + PaddingSize);
+
+		auto* Padding = (LOG_RING_RECORD*) (InProducer->Data + Position);
+		Padding->Size = (ULONG) PaddingSize;
+		Padding->Type = LOG_RING_RECORD_PADDING;
+
+		Offset += PaddingSize;
+		Position = 0;
+		WriteRelease64(&RingHeader->CommitOffset, Offset);
+	}
+
+	// 
+	// Reserve the space for the record before overwriting it, so consumers can detect that the old contents are gone.
+	// 
+
+	InterlockedExchange64(&RingHeader->ReserveOffset, Offset + RecordSize);
+
+	auto* Record = (LOG_RING_RECORD*) (InProducer->Data + Position);
+	Record->Size = (ULONG) RecordSize;
+	Record->Type = InType;
+	Record->Level = InLevel;
+	Record->Sequence = InSequence;
+	Record->Timestamp = InTimestamp;
+	Record->ProcessorIndex = InProcessorIndex;
+	Record->PayloadLength = (ULONG) (InPrefixLength + InPayloadLength);
+	RtlCopyMemory(Record + 1, InPrefix, InPrefixLength);
+	RtlCopyMemory((UCHAR*) (Record + 1) + InPrefixLength, InPayload, InPayloadLength);
+
+	// 
+	// Publish the record.
+	// 
+
+	if (InSequence >= 0)
+		WriteNoFence64(&RingHeader->NextSequence, InSequence + 1);
+
+	WriteRelease64(&RingHeader->CommitOffset, Offset + RecordSize);
+}
+
+/// <summary>
+/// Appends a format string to the string table, and emits its definition record for the consumers which only follow
+/// the stream of records.
+/// Calls must be serialized, as the ring only supports a single producer.
+/// </summary>
+/// <param name="InProducer">The producer.</param>
+/// <param name="InFormat">The format string.</param>
+/// <param name="InNumberOfCharacters">The number of characters in the format string, without its null-terminator.</param>
+/// <param name="InTimestamp">The system time at which the definition record is emitted.</param>
+/// <param name="InProcessorIndex">The index of the processor the definition record is emitted on.</param>
+/// <returns>The identifier of the string, or LOG_RING_INVALID_STRING if the string table is full.</returns>
+inline ULONG LogRingProducerAddString(LOG_RING_PRODUCER* InProducer, CONST WCHAR* InFormat, SIZE_T InNumberOfCharacters, LONG64 InTimestamp, ULONG InProcessorIndex)
+{
+	auto* RingHeader = InProducer->Header;
+
+	auto const Length = (ULONG) ((InNumberOfCharacters + 1) * sizeof(WCHAR));
+	auto const EntrySize = (ULONG) LOG_RING_ALIGN_UP(sizeof(LOG_RING_STRING) + Length);
+	auto const EntryOffset = RingHeader->StringTableCommit;
+
+	if (EntryOffset + EntrySize > RingHeader->StringTableSize)
+		return LOG_RING_INVALID_STRING;
+
+	auto* Entry = (LOG_RING_STRING*) (InProducer->StringTable + EntryOffset);
+	Entry->Size = EntrySize;
+	Entry->Length = Length;
+	RtlCopyMemory(Entry + 1, InFormat, Length);
+	WriteRelease64(&RingHeader->StringTableCommit, EntryOffset + EntrySize);
+
+	LOG_RING_EVENT Definition = { };
+	Definition.StringId = (ULONG) (EntryOffset / LOG_RING_ALIGNMENT);
+	Definition.Length = Length - sizeof(WCHAR);
+
+	LogRingProducerAppend(InProducer, LOG_RING_RECORD_DEFINITION, 0, -1, InTimestamp, InProcessorIndex, &Definition, sizeof(Definition), InFormat, Definition.Length);
+	return Definition.StringId;
+}
+
+/// <summary>
+/// The state of a reference consumer of the shared log ring.
+/// </summary>
+typedef struct _LOG_RING_CONSUMER
+{
+	/// <summary>
+	/// The header of the mapped section.
+	/// </summary>
+	CONST LOG_RING_HEADER* Header;
+
+	/// <summary>
+	/// The data area of the mapped section.
+	/// </summary>
+	CONST UCHAR* Data;
+
+	/// <summary>
+	/// The offset of the next record to read.
+	/// </summary>
+	LONG64 ReadOffset;
+
+	/// <summary>
+	/// The sequence number expected for the next text or event record, or -1 if unknown.
+	/// </summary>
+	LONG64 ExpectedSequence;
+
+	/// <summary>
+	/// The number of records that were overwritten before they could be consumed.
+	/// </summary>
+	LONG64 LostRecords;
+
+} LOG_RING_CONSUMER;
+
+/// <summary>
+/// Attaches a consumer to a mapped log ring.
+/// </summary>
+/// <param name="OutConsumer">The consumer.</param>
+/// <param name="InSection">The base address of the mapped section.</param>
+inline BOOLEAN LogRingConsumerInit(LOG_RING_CONSUMER* OutConsumer, CONST VOID* InSection)
+{
+	auto* Header = (CONST LOG_RING_HEADER*) InSection;
+
+	if (Header->Magic != LOG_RING_MAGIC || Header->Version != LOG_RING_VERSION)
+		return FALSE;
+
+	if (Header->DataSize == 0 || (Header->DataSize & (Header->DataSize - 1)) != 0)
+		return FALSE;
+
+	OutConsumer->Header = Header;
+	OutConsumer->Data = (CONST UCHAR*) InSection + Header->HeaderSize;
+	OutConsumer->ExpectedSequence = -1;
+	OutConsumer->LostRecords = 0;
+
+	// 
+	// Record boundaries are only known from the beginning of the ring, until it wraps around for the first time.
+	// 
+
+	if (ReadAcquire64(&Header->ReserveOffset) <= (LONG64) Header->DataSize)
+		OutConsumer->ReadOffset = 0;
+	else
+		OutConsumer->ReadOffset = ReadAcquire64(&Header->CommitOffset);
+
+	return TRUE;
+}
+
+/// <summary>
+/// Whether the record at the read offset of the consumer may have been overwritten by the producer.
+/// </summary>
+/// <param name="InConsumer">The consumer.</param>
+inline BOOLEAN LogRingConsumerIsOverrun(CONST LOG_RING_CONSUMER* InConsumer)
+{
+	MemoryBarrier();
+	return ReadNoFence64(&InConsumer->Header->ReserveOffset) - InConsumer->ReadOffset > (LONG64) InConsumer->Header->DataSize;
+}
+
+/// <summary>
+/// Returns the next record available in the ring, without copying it, or nullptr if the ring is empty.
+/// The record must be validated with LogRingConsumerRelease once it has been processed.
+/// </summary>
+/// <param name="InConsumer">The consumer.</param>
+inline CONST LOG_RING_RECORD* LogRingConsumerPeek(LOG_RING_CONSUMER* InConsumer)
+{
+	auto const DataSize = (LONG64) InConsumer->Header->DataSize;
+
+	while (TRUE)
+	{
+		auto const CommitOffset = ReadAcquire64(&InConsumer->Header->CommitOffset);
+
+		if (InConsumer->ReadOffset == CommitOffset)
+			return nullptr;
+
+		// 
+		// If the producer already lapped us, resynchronize on the last committed record boundary.
+		// 
+
+		if (LogRingConsumerIsOverrun(InConsumer))
+		{
+			InConsumer->ReadOffset = CommitOffset;
+			continue;
+		}
+
+		auto const Position = InConsumer->ReadOffset & (DataSize - 1);
+		auto const* Record = (CONST LOG_RING_RECORD*) (InConsumer->Data + Position);
+		auto const RecordSize = (LONG64) Record->Size;
+
+		// 
+		// A malformed size can only be observed if the record is being overwritten.
+		// 
+
+		if (RecordSize < (LONG64) sizeof(ULONG) * 2 ||
+			RecordSize > DataSize - Position ||
+			(RecordSize % LOG_RING_ALIGNMENT) != 0)
+		{
+			InConsumer->ReadOffset = CommitOffset;
+			continue;
+		}
+
+		if (Record->Type == LOG_RING_RECORD_PADDING)
+		{
+			InConsumer->ReadOffset += RecordSize;
+			continue;
+		}
+
+		if (RecordSize < (LONG64) sizeof(LOG_RING_RECORD) ||
+			Record->PayloadLength > RecordSize - sizeof(LOG_RING_RECORD))
+		{
+			InConsumer->ReadOffset = CommitOffset;
+			continue;
+		}
+
+		return Record;
+	}
+}
+
+/// <summary>
+/// Advances past a record returned by LogRingConsumerPeek.
+/// Returns FALSE if the record was overwritten while it was being processed, in which case its contents must be discarded.
+/// </summary>
+/// <param name="InConsumer">The consumer.</param>
+/// <param name="InRecord">The record.</param>
+inline BOOLEAN LogRingConsumerRelease(LOG_RING_CONSUMER* InConsumer, CONST LOG_RING_RECORD* InRecord)
+{
+	auto const Size = InRecord->Size;
+	auto const Sequence = InRecord->Sequence;
+
+	if (LogRingConsumerIsOverrun(InConsumer))
+	{
+		InConsumer->ReadOffset = ReadAcquire64(&InConsumer->Header->CommitOffset);
+		return FALSE;
+	}
+
+	// 
+	// Account for the records we skipped since the last one we consumed.
+	// 
+
+	if (Sequence >= 0)
+	{
+		if (InConsumer->ExpectedSequence != -1 && Sequence > InConsumer->ExpectedSequence)
+			InConsumer->LostRecords += Sequence - InConsumer->ExpectedSequence;
+
+		InConsumer->ExpectedSequence = Sequence + 1;
+	}
+
+	InConsumer->ReadOffset += Size;
+	return TRUE;
+}
+
+/// <summary>
+/// Returns a null-terminated format string of the string table, or nullptr if the identifier is not valid.
+/// </summary>
+/// <param name="InConsumer">The consumer.</param>
+/// <param name="InStringId">The identifier of the string.</param>
+inline CONST WCHAR* LogRingConsumerLookupString(CONST LOG_RING_CONSUMER* InConsumer, ULONG InStringId)
+{
+	auto const Offset = (LONG64) InStringId * LOG_RING_ALIGNMENT;
+
+	if (InStringId == LOG_RING_INVALID_STRING ||
+		Offset + (LONG64) sizeof(LOG_RING_STRING) > ReadAcquire64(&InConsumer->Header->StringTableCommit))
+		return nullptr;
+
+	// 
+	// Committed entries are never modified, but still validate them before trusting their length.
+	// 
+
+	auto const* Entry = (CONST LOG_RING_STRING*) ((CONST UCHAR*) InConsumer->Header + InConsumer->Header->StringTableOffset + Offset);
+	auto const* Text = (CONST WCHAR*) (Entry + 1);
+
+	if (Entry->Length < sizeof(WCHAR) ||
+		Entry->Length > Entry->Size - sizeof(LOG_RING_STRING) ||
+		Offset + Entry->Size > ReadAcquire64(&InConsumer->Header->StringTableCommit) ||
+		Text[Entry->Length / sizeof(WCHAR) - 1] != L'\0')
+		return nullptr;
+
+	return Text;
+}
+
+/// <summary>
+/// Renders the message of a text or event record returned by LogRingConsumerPeek.
+/// The record must still be validated with LogRingConsumerRelease before the output can be trusted.
+/// </summary>
+/// <param name="InConsumer">The consumer.</param>
+/// <param name="InRecord">The record.</param>
+/// <param name="OutBuffer">The buffer receiving the null-terminated message.</param>
+/// <param name="InCapacity">The size of the output buffer, in characters.</param>
+/// <returns>The number of characters written to the output buffer, without the null-terminator.</returns>
+inline SIZE_T LogRingConsumerRender(CONST LOG_RING_CONSUMER* InConsumer, CONST LOG_RING_RECORD* InRecord, WCHAR* OutBuffer, SIZE_T InCapacity)
+{
+	if (InCapacity == 0)
+		return 0;
+
+	OutBuffer[0] = L'\0';
+
+	// 
+	// The record may be overwritten while we read it, never trust its lengths past the end of the data area.
+	// 
+
+	auto const Available = (SIZE_T) (InConsumer->Data + InConsumer->Header->DataSize - (CONST UCHAR*) (InRecord + 1));
+	auto PayloadLength = (SIZE_T) InRecord->PayloadLength;
+
+	if (PayloadLength > Available)
+		PayloadLength = Available;
+
+	if (InRecord->Type == LOG_RING_RECORD_TEXT)
+	{
+		auto NumberOfCharacters = PayloadLength / sizeof(WCHAR);
+
+		if (NumberOfCharacters > InCapacity - 1)
+			NumberOfCharacters = InCapacity - 1;
+
+		RtlCopyMemory(OutBuffer, InRecord + 1, NumberOfCharacters * sizeof(WCHAR));
+		OutBuffer[NumberOfCharacters] = L'\0';
+		return NumberOfCharacters;
+	}
+
+	if (InRecord->Type != LOG_RING_RECORD_EVENT || PayloadLength < sizeof(LOG_RING_EVENT))
+		return 0;
+
+	auto const* Event = (CONST LOG_RING_EVENT*) (InRecord + 1);
+	auto const* Format = LogRingConsumerLookupString(InConsumer, Event->StringId);
+	auto const ArgumentsLength = (SIZE_T) Event->Length;
+
+	if (Format == nullptr || ArgumentsLength > PayloadLength - sizeof(LOG_RING_EVENT))
+		return 0;
+
+	return LogFormatRender(Format, (CONST UCHAR*) (Event + 1), ArgumentsLength, OutBuffer, InCapacity);
+}
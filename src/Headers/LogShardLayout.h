@@ -0,0 +1,252 @@
+#pragma once
+
+// 
+// Layout of the shard files written by the ShardedFileProvider, as read back by the LogShardMerge tool.
+// 
+// Every processor appends its records to its own shard file. On machines with more than LOG_SHARD_MAXIMUM_SHARDS
+// processors, a processor appends its records to the shard of its index modulo the number of shards, and the records
+// report the index of the shard as their processor. A shard starts with a LOG_SHARD_HEADER, followed by the records one after the other, without any padding. Every record starts with its
+// magic and its size, and is one of:
+// 
+//  - A text record: a LOG_SHARD_RECORD immediately followed by its message, in UTF-16 and without its null-terminator
+//    nor its break-line.
+//  - An event record: a LOG_SHARD_EVENT immediately followed by the arguments of its format string, encoded as
+//    described in LogFormat.h. The format string itself is only referenced by its identifier.
+//  - A definition record: a LOG_SHARD_STRING immediately followed by a format string, in UTF-16 and without its
+//    null-terminator. It is written once to every shard, before the first event record referencing it.
+// 
+// Definition and event records are only written by a provider storing events, so the text of repetitive messages is
+// stored once per shard instead of once per message. Their identifiers are shared by every shard of a provider.
+// 
+// Records are appended without being flushed, so the tail of a shard may be missing, partially written or filled with
+// zeros after a crash. A reader stops at the first record whose magic, size or checksum is invalid, or which references
+// a format string not defined yet, and ignores the remaining bytes of the shard.
+// 
+// Records of every shard are ordered by their timestamp, then by their sequence number, which is local to the shard.
+// Records of different shards with the same timestamp are ordered by their processor.
+// 
+// This header only depends on the basic Windows types, so it can be included by a user-mode agent after <windows.h>.
+// 
+
+#define LOG_SHARD_MAGIC 0x4453474C
+#define LOG_SHARD_VERSION 2
+
+#define LOG_SHARD_RECORD_MAGIC 0x5253474C
+#define LOG_SHARD_EVENT_MAGIC 0x4553474C
+#define LOG_SHARD_STRING_MAGIC 0x5353474C
+
+#define LOG_SHARD_MAXIMUM_SHARDS 256
+#define LOG_SHARD_MAXIMUM_MESSAGE_LENGTH (64 * 1024)
+#define LOG_SHARD_MAXIMUM_STRINGS 4096
+#define LOG_SHARD_MAXIMUM_STRING_LENGTH 4096
+#define LOG_SHARD_MAXIMUM_ARGUMENTS_LENGTH 4096
+
+/// <summary>
+/// The header at the very beginning of a shard file.
+/// </summary>
+typedef struct _LOG_SHARD_HEADER
+{
+	/// <summary>
+	/// Always equal to LOG_SHARD_MAGIC.
+	/// </summary>
+	ULONG Magic;
+
+	/// <summary>
+	/// The version of this layout, always equal to LOG_SHARD_VERSION.
+	/// </summary>
+	ULONG Version;
+
+	/// <summary>
+	/// The offset of the first record, from the beginning of the file.
+	/// </summary>
+	ULONG HeaderSize;
+
+	/// <summary>
+	/// The index of this shard.
+	/// </summary>
+	ULONG ShardIndex;
+
+	/// <summary>
+	/// The number of shards written by the provider.
+	/// </summary>
+	ULONG NumberOfShards;
+
+	/// <summary>
+	/// Reserved, always zero.
+	/// </summary>
+	ULONG Reserved;
+
+	/// <summary>
+	/// The system time the shard was created at.
+	/// </summary>
+	LONG64 CreationTime;
+} LOG_SHARD_HEADER;
+
+/// <summary>
+/// The header of a text record in a shard file.
+/// </summary>
+typedef struct _LOG_SHARD_RECORD
+{
+	/// <summary>
+	/// Always equal to LOG_SHARD_RECORD_MAGIC.
+	/// </summary>
+	ULONG Magic;
+
+	/// <summary>
+	/// The total size of this record, including this header and the message.
+	/// </summary>
+	ULONG Size;
+
+	/// <summary>
+	/// The system time the message was logged at.
+	/// </summary>
+	LONG64 Timestamp;
+
+	/// <summary>
+	/// The sequence number of the record, in its shard.
+	/// </summary>
+	ULONG64 Sequence;
+
+	/// <summary>
+	/// The severity.
+	/// </summary>
+	ULONG Level;
+
+	/// <summary>
+	/// The index of the processor the message was logged from, or of its shard if it is shared by several processors.
+	/// </summary>
+	ULONG ProcessorIndex;
+
+	/// <summary>
+	/// The number of characters of the message.
+	/// </summary>
+	ULONG MessageLength;
+
+	/// <summary>
+	/// The checksum of the message, as computed by LogShardChecksum.
+	/// </summary>
+	ULONG Checksum;
+} LOG_SHARD_RECORD;
+
+/// <summary>
+/// The header of an event record in a shard file.
+/// </summary>
+typedef struct _LOG_SHARD_EVENT
+{
+	/// <summary>
+	/// Always equal to LOG_SHARD_EVENT_MAGIC.
+	/// </summary>
+	ULONG Magic;
+
+	/// <summary>
+	/// The total size of this record, including this header and the encoded arguments.
+	/// </summary>
+	ULONG Size;
+
+	/// <summary>
+	/// The system time the message was logged at.
+	/// </summary>
+	LONG64 Timestamp;
+
+	/// <summary>
+	/// The sequence number of the record, in its shard.
+	/// </summary>
+	ULONG64 Sequence;
+
+	/// <summary>
+	/// The severity. The message was logged from the processor of the same index as the shard.
+	/// </summary>
+	USHORT Level;
+
+	/// <summary>
+	/// The identifier of the format string, defined by a previous definition record of the shard.
+	/// </summary>
+	USHORT StringId;
+
+	/// <summary>
+	/// The checksum of the encoded arguments, as computed by LogShardChecksum.
+	/// </summary>
+	ULONG Checksum;
+} LOG_SHARD_EVENT;
+
+static_assert(sizeof(LOG_SHARD_EVENT) == 32 && LOG_SHARD_MAXIMUM_STRINGS <= 0x10000, "The event records must stay compact, and reference every format string");
+
+/// <summary>
+/// The header of a definition record in a shard file.
+/// </summary>
+typedef struct _LOG_SHARD_STRING
+{
+	/// <summary>
+	/// Always equal to LOG_SHARD_STRING_MAGIC.
+	/// </summary>
+	ULONG Magic;
+
+	/// <summary>
+	/// The total size of this record, including this header and the format string.
+	/// </summary>
+	ULONG Size;
+
+	/// <summary>
+	/// The identifier of the format string, lower than LOG_SHARD_MAXIMUM_STRINGS.
+	/// </summary>
+	ULONG StringId;
+
+	/// <summary>
+	/// The checksum of the format string, as computed by LogShardChecksum.
+	/// </summary>
+	ULONG Checksum;
+} LOG_SHARD_STRING;
+
+/// <summary>
+/// Computes the checksum of a message, used to detect records torn by a crash.
+/// </summary>
+/// <param name="InMessage">The message.</param>
+/// <param name="InSize">The size of the message, in bytes.</param>
+inline ULONG LogShardChecksum(CONST VOID* InMessage, SIZE_T InSize)
+{
+	ULONG Checksum = 2166136261;
+
+	for (SIZE_T ByteIdx = 0; ByteIdx < InSize; ++ByteIdx)
+	{
+		Checksum ^= ((CONST UCHAR*) InMessage)[ByteIdx];
+		Checksum *= 16777619;
+	}
+
+	return Checksum;
+}
+
+/// <summary>
+/// Checks whether the header of a record is consistent, before its message is read.
+/// </summary>
+/// <param name="InRecord">The header of the record.</param>
+inline BOOLEAN LogShardIsRecordValid(CONST LOG_SHARD_RECORD* InRecord)
+{
+	return InRecord->Magic == LOG_SHARD_RECORD_MAGIC &&
+		InRecord->MessageLength <= LOG_SHARD_MAXIMUM_MESSAGE_LENGTH &&
+		InRecord->Size == sizeof(LOG_SHARD_RECORD) + InRecord->MessageLength * sizeof(WCHAR);
+}
+
+/// <summary>
+/// Checks whether the header of an event record is consistent, before its arguments are read.
+/// </summary>
+/// <param name="InEvent">The header of the record.</param>
+inline BOOLEAN LogShardIsEventValid(CONST LOG_SHARD_EVENT* InEvent)
+{
+	return InEvent->Magic == LOG_SHARD_EVENT_MAGIC &&
+		InEvent->StringId < LOG_SHARD_MAXIMUM_STRINGS &&
+		InEvent->Size >= sizeof(LOG_SHARD_EVENT) &&
+		InEvent->Size - sizeof(LOG_SHARD_EVENT) <= LOG_SHARD_MAXIMUM_ARGUMENTS_LENGTH;
+}
+
+/// <summary>
+/// Checks whether the header of a definition record is consistent, before its format string is read.
+/// </summary>
+/// <param name="InString">The header of the record.</param>
+inline BOOLEAN LogShardIsStringValid(CONST LOG_SHARD_STRING* InString)
+{
+	return InString->Magic == LOG_SHARD_STRING_MAGIC &&
+		InString->StringId < LOG_SHARD_MAXIMUM_STRINGS &&
+		InString->Size >= sizeof(LOG_SHARD_STRING) &&
+		InString->Size - sizeof(LOG_SHARD_STRING) <= LOG_SHARD_MAXIMUM_STRING_LENGTH * sizeof(WCHAR) &&
+		(InString->Size - sizeof(LOG_SHARD_STRING)) % sizeof(WCHAR) == 0;
+}
@@ -0,0 +1,281 @@
+#pragma once
+
+// 
+// Scoped timing spans, aggregated into per-site and per-processor log-linear histograms of cycle counts.
+// 
+// Every power of two is split into LOG_SPAN_SUB_BUCKETS linear sub-buckets, which bounds the relative error of a
+// reported duration to 1 / LOG_SPAN_SUB_BUCKETS, whatever its magnitude. Recording a span reads the cycle counter twice
+// and adds to the histogram of the current processor with two interlocked additions, which other processors do not
+// contend for; nothing is logged until the summaries are reported, on demand or periodically.
+// 
+// A site only allocates the histograms of the processors it actually records spans on, each of them taking
+// sizeof(LogSpanHistogram) bytes of non-paged pool, about 2 KB, plus a table of one pointer per processor of the
+// system. A site entered from every processor of a 64 processors system thus takes about 128 KB.
+// 
+// Usage:
+// 
+//     NTSTATUS DispatchRead(PDEVICE_OBJECT InDevice, PIRP InIrp)
+//     {
+//         LOG_SCOPE(L"DispatchRead");
+//         ...
+//     }
+// 
+
+#define LOG_SPAN_SUB_BUCKET_BITS 2
+#define LOG_SPAN_SUB_BUCKETS (1 << LOG_SPAN_SUB_BUCKET_BITS)
+#define LOG_SPAN_BUCKETS ((64 - LOG_SPAN_SUB_BUCKET_BITS + 1) * LOG_SPAN_SUB_BUCKETS)
+
+/// <summary>
+/// The histogram of the durations recorded by a site on a single processor.
+/// </summary>
+struct DECLSPEC_CACHEALIGN LogSpanHistogram
+{
+	/// <summary>
+	/// The number of spans which lasted a duration falling into each bucket.
+	/// </summary>
+	volatile LONG64 Counts[LOG_SPAN_BUCKETS];
+
+	/// <summary>
+	/// The sum of the durations of every span, in cycles.
+	/// </summary>
+	volatile LONG64 TotalCycles;
+};
+
+/// <summary>
+/// Returns the bucket of the histogram a duration falls into.
+/// </summary>
+/// <param name="InCycles">The duration, in cycles.</param>
+inline ULONG LogSpanGetBucket(ULONG64 InCycles)
+{
+	if (InCycles < LOG_SPAN_SUB_BUCKETS)
+		return (ULONG) InCycles;
+
+	ULONG Exponent;
+
+#if defined(_M_IX86)
+	if ((ULONG) (InCycles >> 32) != 0)
+		_BitScanReverse(&Exponent, (ULONG) (InCycles >> 32)), Exponent += 32;
+	else
+		_BitScanReverse(&Exponent, (ULONG) InCycles);
+#else
+	_BitScanReverse64(&Exponent, InCycles);
+#endif
+
+	auto const SubBucket = (ULONG) (InCycles >> (Exponent - LOG_SPAN_SUB_BUCKET_BITS)) & (LOG_SPAN_SUB_BUCKETS - 1);
+	return (Exponent - LOG_SPAN_SUB_BUCKET_BITS + 1) * LOG_SPAN_SUB_BUCKETS + SubBucket;
+}
+
+/// <summary>
+/// Returns the highest duration falling into a bucket of the histogram.
+/// </summary>
+/// <param name="InBucket">The bucket.</param>
+inline ULONG64 LogSpanGetBucketUpperBound(ULONG InBucket)
+{
+	if (InBucket < LOG_SPAN_SUB_BUCKETS)
+		return InBucket;
+
+	auto const Shift = InBucket / LOG_SPAN_SUB_BUCKETS - 1;
+	auto const LowerBound = (ULONG64) (LOG_SPAN_SUB_BUCKETS + InBucket % LOG_SPAN_SUB_BUCKETS) << Shift;
+	return LowerBound + ((1ull << Shift) - 1);
+}
+
+/// <summary>
+/// A site of the code whose durations are measured, typically declared as a static variable by LOG_SCOPE.
+/// Sites must be constant-initialized, as the kernel does not run dynamic initializers.
+/// </summary>
+struct LogSpanSite
+{
+	/// <summary>
+	/// The name of this site, used in the summaries.
+	/// </summary>
+	CONST WCHAR* Name;
+
+	/// <summary>
+	/// The table of the histograms of this site, one entry per processor, allocated the first time a span is recorded.
+	/// The histogram of a processor is only allocated the first time a span is recorded on it.
+	/// </summary>
+	LogSpanHistogram* volatile* volatile Histograms;
+
+	/// <summary>
+	/// The number of entries in the table of histograms.
+	/// </summary>
+	ULONG NumberOfHistograms;
+
+	/// <summary>
+	/// The next site in the list of registered sites.
+	/// </summary>
+	LogSpanSite* Next;
+
+	/// <summary>
+	/// Records the duration of a span.
+	/// </summary>
+	/// <param name="InCycles">The duration, in cycles.</param>
+	void Record(ULONG64 InCycles)
+	{
+		auto* PerProcessorHistograms = (LogSpanHistogram* volatile*) ReadPointerAcquire((PVOID*) &this->Histograms);
+
+		if (PerProcessorHistograms == nullptr)
+		{
+			// 
+			// The histograms cannot be allocated above DISPATCH_LEVEL, drop the spans recorded there until the site
+			// records one at a lower level.
+			// 
+
+			if (KeGetCurrentIrql() > DISPATCH_LEVEL)
+				return;
+
+			if ((PerProcessorHistograms = this->Register()) == nullptr)
+				return;
+		}
+
+		// 
+		// The thread may be rescheduled on another processor right after reading the index,
+		// the interlocked operations keep the counters exact without making them contended.
+		// 
+
+		auto const ProcessorIndex = KeGetCurrentProcessorIndex();
+
+		if (ProcessorIndex >= this->NumberOfHistograms)
+			return;
+
+		auto* Histogram = (LogSpanHistogram*) ReadPointerAcquire((PVOID*) &PerProcessorHistograms[ProcessorIndex]);
+
+		if (Histogram == nullptr)
+		{
+			if (KeGetCurrentIrql() > DISPATCH_LEVEL)
+				return;
+
+			if ((Histogram = this->AllocateHistogram(ProcessorIndex)) == nullptr)
+				return;
+		}
+
+		InterlockedIncrementNoFence64(&Histogram->Counts[LogSpanGetBucket(InCycles)]);
+		InterlockedAddNoFence64(&Histogram->TotalCycles, (LONG64) InCycles);
+	}
+
+	/// <summary>
+	/// Allocates the table of the histograms of this site and adds it to the list of registered sites.
+	/// Must be called at an IRQL lower or equal to DISPATCH_LEVEL.
+	/// </summary>
+	/// <returns>The table of the histograms of this site, or nullptr if it could not be allocated.</returns>
+	LogSpanHistogram* volatile* Register();
+
+	/// <summary>
+	/// Allocates the histogram of this site for a processor.
+	/// Must be called at an IRQL lower or equal to DISPATCH_LEVEL.
+	/// </summary>
+	/// <param name="InProcessorIndex">The index of the processor.</param>
+	/// <returns>The histogram of the processor, or nullptr if it could not be allocated.</returns>
+	LogSpanHistogram* AllocateHistogram(ULONG InProcessorIndex);
+};
+
+/// <summary>
+/// Measures the duration of the enclosing scope.
+/// </summary>
+class LogScope
+{
+private:
+
+	/// <summary>
+	/// The site this scope is recorded to.
+	/// </summary>
+	LogSpanSite& Site;
+
+	/// <summary>
+	/// The value of the cycle counter when this scope was entered.
+	/// </summary>
+	ULONG64 StartCycles;
+
+public:
+
+	explicit LogScope(LogSpanSite& InSite) : Site(InSite), StartCycles(ReadTimeStampCounter())
+	{
+		// ...
+	}
+
+	~LogScope()
+	{
+		this->Site.Record(ReadTimeStampCounter() - this->StartCycles);
+	}
+
+	LogScope(CONST LogScope&) = delete;
+	LogScope& operator=(CONST LogScope&) = delete;
+};
+
+#define LOG_SPAN_CONCAT_INNER(Left, Right) Left##Right
+#define LOG_SPAN_CONCAT(Left, Right) LOG_SPAN_CONCAT_INNER(Left, Right)
+
+/// <summary>
+/// Measures the duration of the enclosing scope, and aggregates it under the specified name.
+/// The histogram of a site for a processor is allocated the first time the site records a span on that processor at an
+/// IRQL lower or equal to DISPATCH_LEVEL; the spans recorded above DISPATCH_LEVEL before that, e.g. in an interrupt
+/// service routine, are dropped.
+/// </summary>
+#define LOG_SCOPE(Name) \
+	static LogSpanSite LOG_SPAN_CONCAT(LogSpanSite_, __LINE__) = { Name }; \
+	LogScope LOG_SPAN_CONCAT(LogScope_, __LINE__)(LOG_SPAN_CONCAT(LogSpanSite_, __LINE__))
+
+/// <summary>
+/// Periodically reports the summaries of every site to a logger, from a system thread.
+/// </summary>
+class LogSpanReporter
+{
+private:
+
+	/// <summary>
+	/// The logger the summaries are reported to.
+	/// </summary>
+	Logger* Target = nullptr;
+
+	/// <summary>
+	/// The interval between two reports, as a relative time.
+	/// </summary>
+	LARGE_INTEGER Interval = { };
+
+	/// <summary>
+	/// The event signaled to stop the reporting thread.
+	/// </summary>
+	KEVENT StopEvent = { };
+
+	/// <summary>
+	/// The reporting thread.
+	/// </summary>
+	PKTHREAD Thread = nullptr;
+
+public:
+
+	/// <summary>
+	/// Starts reporting the summaries of every site periodically.
+	/// Must be called at PASSIVE_LEVEL.
+	/// </summary>
+	/// <param name="InLogger">The logger the summaries are reported to.</param>
+	/// <param name="InIntervalInMilliseconds">The interval between two reports.</param>
+	NTSTATUS Start(Logger& InLogger, ULONG InIntervalInMilliseconds);
+
+	/// <summary>
+	/// Stops reporting, after a last report.
+	/// Must be called at PASSIVE_LEVEL.
+	/// </summary>
+	void Stop();
+
+private:
+
+	/// <summary>
+	/// The routine of the reporting thread.
+	/// </summary>
+	/// <param name="InContext">The reporter.</param>
+	static void ThreadRoutine(PVOID InContext);
+};
+
+/// <summary>
+/// Logs a summary of the durations recorded by every site: count, mean, 50th, 90th and 99th percentiles, and maximum.
+/// </summary>
+/// <param name="InLogger">The logger the summaries are reported to.</param>
+/// <param name="InShouldReset">Whether the histograms should be reset after being reported.</param>
+void LogSpanReport(Logger& InLogger, BOOLEAN InShouldReset);
+
+/// <summary>
+/// Releases the histograms of every site.
+/// Must be called once no span can be recorded anymore, typically when the driver is unloaded.
+/// </summary>
+void LogSpanExit();
@@ -6,47 +6,456 @@ inline void* __cdecl operator new(size_t size, void* location)
 	return location;
 }
 
-namespace LoggerNT
+/// <summary>
+/// A message logged while no provider was registered, stored without being formatted.
+/// The record is followed by a copy of the format of the message, null-terminated, then by the encoded arguments.
+/// </summary>
+struct LoggerEarlyRecord
 {
 	/// <summary>
-	/// The configuration of the logging system.
+	/// The total size of this record, including this header and the alignment.
+	/// </summary>
+	ULONG Size;
+
+	/// <summary>
+	/// The number of characters of the format following this header, including its null-terminator.
+	/// </summary>
+	ULONG FormatLength;
+
+	/// <summary>
+	/// The size of the encoded arguments following the format.
+	/// </summary>
+	ULONG ArgumentsLength;
+
+	/// <summary>
+	/// The severity.
 	/// </summary>
-	inline LoggerConfig Config = { };
+	ELogLevel Level;
 
 	/// <summary>
-	/// Whether this class has been setup or not.
+	/// The time the message was logged at.
 	/// </summary>
-	inline BOOLEAN IsSetup = FALSE;
+	LARGE_INTEGER Timestamp;
+
+	/// <summary>
+	/// The index of the processor the message was logged from.
+	/// </summary>
+	ULONG ProcessorIndex;
+};
+
+/// <summary>
+/// The number of messages being delivered to the event providers by a group of processors.
+/// Every counter has its own cache line, so processors never share one unless there are more processors than counters.
+/// </summary>
+struct DECLSPEC_CACHEALIGN LoggerDeliveryCounter
+{
+	/// <summary>
+	/// The number of messages being delivered.
+	/// </summary>
+	volatile LONG Count;
+};
+
+#define LOGGER_NT_NUMBER_OF_DELIVERY_COUNTERS 64
+
+// 
+// The number of slots holding the configuration of a logger: the active one, and the one rewritten by the next reconfiguration.
+// 
+
+#define LOGGER_NT_NUMBER_OF_CONFIG_SNAPSHOTS 2
+
+/// <summary>
+/// An independent logger instance, with its own configuration, providers and buffers.
+/// </summary>
+class Logger
+{
+public:
+
+	/// <summary>
+	/// The slots holding the configuration of this logger, recycled every time it is reconfigured.
+	/// </summary>
+	LoggerConfigSnapshot ConfigSnapshots[LOGGER_NT_NUMBER_OF_CONFIG_SNAPSHOTS] = { };
+
+	/// <summary>
+	/// The index of the slot holding the configuration currently used by this logger, replaced as a whole when it is reconfigured.
+	/// </summary>
+	volatile LONG ActiveConfigIndex = 0;
+
+	/// <summary>
+	/// The synchronization spin lock for the reconfigurations.
+	/// </summary>
+	KSPIN_LOCK ConfigLock = { };
+
+	/// <summary>
+	/// Whether this logger has been setup or not.
+	/// </summary>
+	BOOLEAN IsSetup = FALSE;
 
 	/// <summary>
 	/// The synchronization spin lock for the providers list.
 	/// </summary>
-	inline KSPIN_LOCK ProvidersLock = { };
+	KSPIN_LOCK ProvidersLock = { };
 
 	/// <summary>
 	/// The list of providers currently used by this logger.
 	/// </summary>
-	inline ILogProvider* Providers[16] = { };
+	ILogProvider* Providers[16] = { };
+
+	/// <summary>
+	/// Whether the provider at the same index was allocated by this logger.
+	/// </summary>
+	BOOLEAN IsProviderOwned[16] = { };
 
 	/// <summary>
 	/// The number of entries in the list of providers.
 	/// </summary>
-	inline LONG NumberOfProviders = 0;
+	LONG NumberOfProviders = 0;
+
+	/// <summary>
+	/// The list of event providers currently used by this logger, which are called without any lock held, except
+	/// while the messages are kept in the early buffer.
+	/// </summary>
+	ILogEventProvider* EventProviders[16] = { };
+
+	/// <summary>
+	/// Whether the event provider at the same index was allocated by this logger.
+	/// </summary>
+	BOOLEAN IsEventProviderOwned[16] = { };
+
+	/// <summary>
+	/// The number of entries in the list of event providers.
+	/// </summary>
+	LONG NumberOfEventProviders = 0;
+
+	/// <summary>
+	/// The number of messages being delivered to the event providers, counted per processor.
+	/// </summary>
+	LoggerDeliveryCounter EventDeliveries[LOGGER_NT_NUMBER_OF_DELIVERY_COUNTERS] = { };
 
 	/// <summary>
 	/// The synchronization spin lock for log processing.
 	/// </summary>
-	inline KSPIN_LOCK LogProcessingLock = { };
+	KSPIN_LOCK LogProcessingLock = { };
 
 	/// <summary>
 	/// The buffer used to store the formatted output.
 	/// </summary>
-	inline WCHAR* LogProcessingBuffer = nullptr;
+	WCHAR* LogProcessingBuffer = nullptr;
 
 	/// <summary>
 	/// The size of the buffer used to store the formatted output.
 	/// </summary>
-	inline SIZE_T LogProcessBufferSize = 0;
+	SIZE_T LogProcessBufferSize = 0;
+
+	/// <summary>
+	/// The ring of records shared with user-mode consumers, if enabled.
+	/// </summary>
+	LogRing* Ring = nullptr;
+
+	/// <summary>
+	/// The buffer storing the header of the record being logged, shared by every provider.
+	/// </summary>
+	CHAR HeaderBuffer[LOG_RECORD_MAXIMUM_HEADER_LENGTH] = { };
+
+	/// <summary>
+	/// The sequence number of the next record delivered to the providers.
+	/// </summary>
+	ULONG64 NextSequence = 0;
+
+	/// <summary>
+	/// The buffer storing the messages logged while no provider was registered.
+	/// </summary>
+	DECLSPEC_ALIGN(8) UCHAR EarlyBuffer[LOGGER_NT_EARLY_BUFFER_SIZE] = { };
+
+	/// <summary>
+	/// The number of bytes used in the early buffer.
+	/// </summary>
+	ULONG EarlyBufferLength = 0;
+
+	/// <summary>
+	/// The number of messages which could not be stored in the early buffer.
+	/// </summary>
+	ULONG NumberOfDroppedEarlyRecords = 0;
+
+public:
+
+	/// <summary>
+	/// Initializes this logger.
+	/// </summary>
+	/// <param name="InConfig">The configuration.</param>
+	NTSTATUS Init(CONST LoggerConfig& InConfig);
+
+	/// <summary>
+	/// Replaces the configuration of this logger, without pausing the logging on other processors.
+	/// Messages being logged while the configuration is replaced use either the previous or the new one, never a mix of both.
+	/// Must be called at an IRQL lower or equal to DISPATCH_LEVEL.
+	/// </summary>
+	/// <param name="InConfig">The new configuration.</param>
+	NTSTATUS Reconfigure(CONST LoggerConfig& InConfig);
+
+	/// <summary>
+	/// Gets a copy of the configuration currently used by this logger.
+	/// </summary>
+	LoggerConfig GetConfig();
+
+	/// <summary>
+	/// Destroys the providers of this logger and releases its buffers.
+	/// </summary>
+	void Exit();
+
+	/// <summary>
+	/// Enables the ring of records which can be mapped by user-mode consumers.
+	/// Must be called at PASSIVE_LEVEL.
+	/// </summary>
+	/// <param name="InDataSize">The size of the data area of the ring.</param>
+	/// <param name="InStringTableSize">The size of the table of interned format strings.</param>
+	NTSTATUS EnableSharedRing(ULONG InDataSize, ULONG InStringTableSize = 64 * 1024);
+
+	/// <summary>
+	/// Adds a logging provider to this logger instance.
+	/// The messages kept in the early buffer are replayed to it first, whether it is a provider or an event provider.
+	/// </summary>
+	/// <param name="InProvider">An existing instance of the logging provider.</param>
+	template <class TProvider>
+	TProvider* AddProvider(OPTIONAL TProvider* InProvider = nullptr)
+	{
+		static_assert(__is_base_of(::ILogProvider, TProvider) || __is_base_of(::ILogEventProvider, TProvider), "The logging provider is not based on ILogProvider nor ILogEventProvider");
+
+		// 
+		// If a provider instance wasn't specified, create one.
+		// 
+
+		BOOLEAN IsOwned = FALSE;
+
+		if (InProvider == nullptr)
+		{
+			InProvider = (TProvider*) ExAllocatePoolZero(NonPagedPoolNx, sizeof(TProvider), LOGGER_NT_POOL_TAG);
+
+			if (InProvider == nullptr)
+				return nullptr;
+
+			InProvider = new(InProvider) TProvider();
+			IsOwned = TRUE;
+		}
+
+		// 
+		// Event providers are called outside of the locks, they have their own list.
+		// 
+
+		if constexpr (__is_base_of(::ILogEventProvider, TProvider))
+		{
+			if (!this->AddEventProvider(InProvider, IsOwned))
+			{
+				if (IsOwned)
+					ExFreePoolWithTag(InProvider, LOGGER_NT_POOL_TAG);
+
+				return nullptr;
+			}
+
+			return InProvider;
+		}
+		else
+		{
+			// 
+			// Add the provider to the list of providers, after replaying the early messages to it.
+			// Both locks are held so no message can be delivered to it before the early ones.
+			// 
+
+			KIRQL OldIrql;
+			KeAcquireSpinLock(&this->LogProcessingLock, &OldIrql);
+			KeAcquireSpinLockAtDpcLevel(&this->ProvidersLock);
+
+			if (this->NumberOfProviders >= (LONG) ARRAYSIZE(this->Providers))
+			{
+				KeReleaseSpinLockFromDpcLevel(&this->ProvidersLock);
+				KeReleaseSpinLock(&this->LogProcessingLock, OldIrql);
+
+				if (IsOwned)
+					ExFreePoolWithTag(InProvider, LOGGER_NT_POOL_TAG);
+
+				return nullptr;
+			}
+
+			this->ReplayEarlyRecords(InProvider);
+			this->IsProviderOwned[this->NumberOfProviders] = IsOwned;
+			InterlockedExchangePointer((PVOID*) &this->Providers[InterlockedIncrement(&this->NumberOfProviders) - 1], InProvider);
+			KeReleaseSpinLockFromDpcLevel(&this->ProvidersLock);
+			KeReleaseSpinLock(&this->LogProcessingLock, OldIrql);
+			return InProvider;
+		}
+	}
+
+	/// <summary>
+	/// Discards the messages logged while no provider was registered, which will not be replayed anymore.
+	/// </summary>
+	void DiscardEarlyRecords();
+
+	/// <summary>
+	/// Logs a message of the specified log level.
+	/// </summary>
+	/// <param name="InLogLevel">The severity.</param>
+	/// <param name="InFormat">The format of the message.</param>
+	/// <param name="InArguments">The arguments for the message format.</param>
+	void Logv(ELogLevel InLogLevel, CONST WCHAR* InFormat, va_list InArguments);
+
+	/// <summary>
+	/// Logs a binary payload as a hexadecimal dump, streamed in chunks of bounded size.
+	/// The chunks are not atomic with each other: other messages, including the lines of other dumps, may be logged between
+	/// two chunks. Every line starts with its offset in the payload.
+	/// </summary>
+	/// <param name="InLogLevel">The severity.</param>
+	/// <param name="InTitle">The title of the dump.</param>
+	/// <param name="InData">The payload.</param>
+	/// <param name="InSize">The size of the payload.</param>
+	void HexDump(ELogLevel InLogLevel, CONST WCHAR* InTitle, CONST VOID* InData, SIZE_T InSize);
+
+	/// <summary>
+	/// Logs a message of the specified log level.
+	/// </summary>
+	/// <param name="InLogLevel">The severity.</param>
+	/// <param name="InFormat">The format of the message.</param>
+	/// <param name="...">The arguments for the message format.</param>
+	void Log(ELogLevel InLogLevel, CONST WCHAR* InFormat, ...);
+
+	/// <summary>
+	/// Logs a message with the 'Trace' severity level.
+	/// </summary>
+	/// <param name="InFormat">The format of the message.</param>
+	/// <param name="...">The arguments for the message format.</param>
+	void Trace(CONST WCHAR* InFormat, ...);
+
+	/// <summary>
+	/// Logs a message with the 'Debug' severity level.
+	/// </summary>
+	/// <param name="InFormat">The format of the message.</param>
+	/// <param name="...">The arguments for the message format.</param>
+	void Debug(CONST WCHAR* InFormat, ...);
+
+	/// <summary>
+	/// Logs a message with the 'Information' severity level.
+	/// </summary>
+	/// <param name="InFormat">The format of the message.</param>
+	/// <param name="...">The arguments for the message format.</param>
+	void Info(CONST WCHAR* InFormat, ...);
+
+	/// <summary>
+	/// Logs a message with the 'Warning' severity level.
+	/// </summary>
+	/// <param name="InFormat">The format of the message.</param>
+	/// <param name="...">The arguments for the message format.</param>
+	void Warning(CONST WCHAR* InFormat, ...);
+
+	/// <summary>
+	/// Logs a message with the 'Error' severity level.
+	/// </summary>
+	/// <param name="InFormat">The format of the message.</param>
+	/// <param name="...">The arguments for the message format.</param>
+	void Error(CONST WCHAR* InFormat, ...);
+
+	/// <summary>
+	/// Logs a message with the 'Fatal' severity level.
+	/// </summary>
+	/// <param name="InFormat">The format of the message.</param>
+	/// <param name="...">The arguments for the message format.</param>
+	void Fatal(CONST WCHAR* InFormat, ...);
+
+private:
+
+	/// <summary>
+	/// Makes sure the buffer used to store the formatted output can hold the specified number of characters.
+	/// Must be called with the log processing lock held.
+	/// </summary>
+	/// <param name="InNumberOfCharacters">The number of characters, including the break-line and the null-terminator.</param>
+	BOOLEAN ReserveProcessingBuffer(SIZE_T InNumberOfCharacters);
+
+	/// <summary>
+	/// Gets a copy of the configuration currently used by this logger, without taking any lock.
+	/// </summary>
+	LoggerConfig ReadConfig();
+
+	/// <summary>
+	/// Renders the header of a record into the header buffer, as configured.
+	/// Must be called with the log processing lock held.
+	/// </summary>
+	/// <param name="InConfig">The configuration the header is rendered with.</param>
+	/// <param name="InLogLevel">The severity.</param>
+	/// <param name="InMessage">The message, ending with a break-line.</param>
+	/// <param name="InMessageLength">The number of characters of the message, including the break-line.</param>
+	/// <param name="InTimestamp">The time the message was logged at, or nullptr if it was logged now.</param>
+	/// <param name="InProcessorIndex">The index of the processor the message was logged from, or MAXULONG if it is the current one.</param>
+	LogRecord MakeRecord(CONST LoggerConfig& InConfig, ELogLevel InLogLevel, CONST WCHAR* InMessage, SIZE_T InMessageLength, OPTIONAL CONST LARGE_INTEGER* InTimestamp = nullptr, ULONG InProcessorIndex = MAXULONG);
+
+	/// <summary>
+	/// Adds an event provider to the list of event providers, after replaying the early messages to it.
+	/// </summary>
+	/// <param name="InProvider">The event provider.</param>
+	/// <param name="InIsOwned">Whether the event provider was allocated by this logger.</param>
+	BOOLEAN AddEventProvider(ILogEventProvider* InProvider, BOOLEAN InIsOwned);
+
+	/// <summary>
+	/// Delivers a message to every event provider, from the current processor and without taking any lock.
+	/// </summary>
+	/// <param name="InLogLevel">The severity.</param>
+	/// <param name="InFormat">The format of the message.</param>
+	/// <param name="InArguments">The arguments for the message format.</param>
+	void DeliverEventv(ELogLevel InLogLevel, CONST WCHAR* InFormat, va_list InArguments);
+
+	/// <summary>
+	/// Delivers a message to every event provider, from the current processor and without taking any lock.
+	/// </summary>
+	/// <param name="InLogLevel">The severity.</param>
+	/// <param name="InFormat">The format of the message.</param>
+	/// <param name="...">The arguments for the message format.</param>
+	void DeliverEvent(ELogLevel InLogLevel, CONST WCHAR* InFormat, ...);
+
+	/// <summary>
+	/// Stores a message in the early buffer, without formatting it.
+	/// Must be called with the log processing lock held.
+	/// </summary>
+	/// <param name="InLogLevel">The severity.</param>
+	/// <param name="InFormat">The format of the message.</param>
+	/// <param name="InArguments">The arguments for the message format.</param>
+	void StoreEarlyRecordv(ELogLevel InLogLevel, CONST WCHAR* InFormat, va_list InArguments);
+
+	/// <summary>
+	/// Stores a message in the early buffer, without formatting it.
+	/// Must be called with the log processing lock held.
+	/// </summary>
+	/// <param name="InLogLevel">The severity.</param>
+	/// <param name="InFormat">The format of the message.</param>
+	/// <param name="...">The arguments for the message format.</param>
+	void StoreEarlyRecord(ELogLevel InLogLevel, CONST WCHAR* InFormat, ...);
+
+	/// <summary>
+	/// Formats the messages stored in the early buffer, and logs them to a single provider, in order.
+	/// Must be called with the log processing lock held.
+	/// </summary>
+	/// <param name="InProvider">The provider.</param>
+	void ReplayEarlyRecords(ILogProvider* InProvider);
+
+	/// <summary>
+	/// Formats the messages stored in the early buffer, and delivers them to a single event provider, in order.
+	/// The event provider receives them as already formatted messages, stamped with the time they are replayed at.
+	/// Must be called with the log processing lock held.
+	/// </summary>
+	/// <param name="InProvider">The event provider.</param>
+	void ReplayEarlyRecords(ILogEventProvider* InProvider);
+
+	/// <summary>
+	/// Delivers a message to a single event provider.
+	/// </summary>
+	/// <param name="InProvider">The event provider.</param>
+	/// <param name="InLogLevel">The severity.</param>
+	/// <param name="InFormat">The format of the message.</param>
+	/// <param name="...">The arguments for the message format.</param>
+	void ReplayEvent(ILogEventProvider* InProvider, ELogLevel InLogLevel, CONST WCHAR* InFormat, ...);
+};
+
+namespace LoggerNT
+{
+	/// <summary>
+	/// The default logger instance, used by the free logging functions.
+	/// </summary>
+	inline Logger DefaultLogger = { };
 }
 
 /// <summary>
@@ -56,33 +465,20 @@ namespace LoggerNT
 NTSTATUS LogInitLibrary(CONST LoggerConfig& InConfig);
 
 /// <summary>
-/// Adds a logging provider to this logger instance.
+/// Replaces the configuration of the default logger instance, without pausing the logging on other processors.
+/// Must be called at an IRQL lower or equal to DISPATCH_LEVEL.
+/// </summary>
+/// <param name="InConfig">The new configuration.</param>
+NTSTATUS LogReconfigure(CONST LoggerConfig& InConfig);
+
+/// <summary>
+/// Adds a logging provider to the default logger instance.
 /// </summary>
 /// <param name="InProvider">An existing instance of the logging provider.</param>
 template <class TProvider>
 TProvider* LogAddProvider(OPTIONAL TProvider* InProvider = nullptr)
 {
-	static_assert(__is_base_of(::ILogProvider, TProvider), "The logging provider is not based on ILogProvider");
-	
-	// 
-	// If a provider instance wasn't specified, create one.
-	// 
-
-	if (InProvider == nullptr)
-	{
-		InProvider = (TProvider*) ExAllocatePoolZero(NonPagedPoolNx, sizeof(TProvider), LOGGER_NT_POOL_TAG);
-		InProvider = new(InProvider) TProvider();
-	}
-	
-	// 
-	// Add the provider to the list of providers.
-	// 
-
-	KIRQL OldIrql;
-	KeAcquireSpinLock(&LoggerNT::ProvidersLock, &OldIrql);
-	InterlockedExchangePointer((PVOID*) &LoggerNT::Providers[InterlockedIncrement(&LoggerNT::NumberOfProviders) - 1], InProvider);
-	KeReleaseSpinLock(&LoggerNT::ProvidersLock, OldIrql);
-	return InProvider;
+	return LoggerNT::DefaultLogger.AddProvider<TProvider>(InProvider);
 }
 
 /// <summary>
@@ -93,6 +489,17 @@ TProvider* LogAddProvider(OPTIONAL TProvider* InProvider = nullptr)
 /// <param name="InArguments">The arguments for the message format.</param>
 void Logv(ELogLevel InLogLevel, CONST WCHAR* InFormat, va_list InArguments);
 
+/// <summary>
+/// Logs a binary payload as a hexadecimal dump, streamed in chunks of bounded size.
+/// The chunks are not atomic with each other: other messages, including the lines of other dumps, may be logged between
+/// two chunks. Every line starts with its offset in the payload.
+/// </summary>
+/// <param name="InLogLevel">The severity.</param>
+/// <param name="InTitle">The title of the dump.</param>
+/// <param name="InData">The payload.</param>
+/// <param name="InSize">The size of the payload.</param>
+void LogHexDump(ELogLevel InLogLevel, CONST WCHAR* InTitle, CONST VOID* InData, SIZE_T InSize);
+
 /// <summary>
 /// Logs a message of the specified log level.
 /// </summary>
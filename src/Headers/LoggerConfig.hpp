@@ -8,4 +8,45 @@ public:
 	/// The minimum level of severity for a log output to be transferred to the logging providers.
 	/// </summary>
 	ELogLevel MinimumLevel = ELogLevel::Trace;
+
+	/// <summary>
+	/// Whether the messages logged while no provider is registered should be kept, to be replayed to the providers once they are registered.
+	/// </summary>
+	BOOLEAN EnableEarlyBuffering = TRUE;
+
+	/// <summary>
+	/// Whether the header of every record should start with the local time it was logged at.
+	/// </summary>
+	BOOLEAN ShouldPrefixTimestamp = FALSE;
+
+	/// <summary>
+	/// Whether the header of every record should contain the index of the processor it was logged from.
+	/// </summary>
+	BOOLEAN ShouldPrefixProcessor = FALSE;
+};
+
+/// <summary>
+/// A version of the configuration of a logger, held in one of the few slots the logger recycles.
+/// Reconfiguring a logger rewrites a slot which is not in use and publishes it, so no memory is ever allocated for it.
+/// Readers copy the configuration out of the active slot without taking any lock or reference, and copy it again if
+/// the slot was rewritten in the meantime.
+/// </summary>
+struct LoggerConfigSnapshot
+{
+public:
+
+	/// <summary>
+	/// The number of times this slot was rewritten, twice per rewrite: it is odd while the slot is being rewritten.
+	/// </summary>
+	volatile LONG64 Sequence = 0;
+
+	/// <summary>
+	/// The version of this snapshot, incremented every time a logger is reconfigured.
+	/// </summary>
+	ULONG64 Version = 0;
+
+	/// <summary>
+	/// The configuration.
+	/// </summary>
+	LoggerConfig Config = { };
 };
\ No newline at end of file
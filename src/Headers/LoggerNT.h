@@ -19,14 +19,31 @@
 #define LOGGER_NT_VERSION_BUILD 0
 #define LOGGER_NT_POOL_TAG 0
 
+#ifndef LOGGER_NT_EARLY_BUFFER_SIZE
+#define LOGGER_NT_EARLY_BUFFER_SIZE (16 * 1024)
+#endif
+
+#ifndef LOGGER_NT_MAXIMUM_MESSAGE_LENGTH
+#define LOGGER_NT_MAXIMUM_MESSAGE_LENGTH 4096
+#endif
+
+static_assert(LOGGER_NT_MAXIMUM_MESSAGE_LENGTH > 12, "The maximum length of a message must leave room for the truncation marker");
+
 // 
 // Include the library headers.
 // 
 
 #include "LogLevel.hpp"
+#include "LogRecord.hpp"
 #include "LogProvider.hpp"
 #include "LoggerConfig.hpp"
+#include "LogFormat.h"
+#include "LogHexDump.h"
+#include "LogRingLayout.h"
+#include "LogShardLayout.h"
+#include "LogRing.hpp"
 #include "Logger.hpp"
+#include "LogSpan.hpp"
 
 // 
 // Include the default logging providers.
@@ -35,3 +52,4 @@
 #include "Providers/DbgPrintProvider.hpp"
 #include "Providers/TempFileProvider.hpp"
 #include "Providers/SerialPortProvider.hpp"
+#include "Providers/ShardedFileProvider.hpp"
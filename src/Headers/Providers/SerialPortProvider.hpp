@@ -5,76 +5,20 @@ class SerialPortProvider : public ILogProvider
 public:
 	
 	/// <summary>
-	/// Logs a message of the specified severity.
+	/// Logs a record, made of its header and its message.
 	/// </summary>
-	/// <param name="InLogLevel">The severity.</param>
-	/// <param name="InMessage">The message.</param>
-	void Log(ELogLevel InLogLevel, CONST WCHAR* InMessage) override
+	/// <param name="InRecord">The record.</param>
+	void Log(CONST LogRecord& InRecord) override
 	{
 		// 
-		// Select the correct prefix for this log level.
+		// Convert the record to ANSI and write it a chunk at a time, the header starting the first one.
 		// 
 
-		switch (InLogLevel)
+		LogProviderConvertToAnsi(InRecord, [] (CONST CHAR* InChunk, SIZE_T InLength) -> BOOLEAN
 		{
-			case ELogLevel::Trace:
-				SerialWrite("   TRACE   :  ", 14);
-				break;
-			
-			case ELogLevel::Debug:
-				SerialWrite("   DEBUG   :  ", 14);
-				break;
-			
-			case ELogLevel::Information:
-				SerialWrite("    INF    :  ", 14);
-				break;
-			
-			case ELogLevel::Warning:
-				SerialWrite("    WRN    :  ", 14);
-				break;
-			
-			case ELogLevel::Error:
-				SerialWrite("   ERROR   :  ", 14);
-				break;
-			
-			case ELogLevel::Fatal:
-				SerialWrite("   FATAL   :  ", 14);
-				break;
-
-			default:
-                SerialWrite("    UNK    :  ", 14);
-				break;
-		}
-
-        // 
-		// Convert the UNICODE string to an ANSI string.
-		// 
-
-		UNICODE_STRING UnicodeMessage;
-		UnicodeMessage.Buffer = (PWCH) InMessage;
-		UnicodeMessage.Length = (USHORT) wcslen(InMessage) * sizeof(WCHAR);
-		UnicodeMessage.MaximumLength = UnicodeMessage.Length + sizeof(WCHAR);
-		
-		ANSI_STRING AnsiMessage;
-		AnsiMessage.Buffer = (PCHAR) ExAllocatePoolZero(NonPagedPoolNx, UnicodeMessage.MaximumLength, LOGGER_NT_POOL_TAG);
-		AnsiMessage.Length = 0;
-		AnsiMessage.MaximumLength = UnicodeMessage.MaximumLength;
-		
-		if (NT_SUCCESS(RtlUnicodeStringToAnsiString(&AnsiMessage, &UnicodeMessage, false)))
-		{
-			//
-			// Write the message.
-			// 
-
-			SerialWrite(AnsiMessage.Buffer, AnsiMessage.Length);
-		}
-
-		// 
-		// Release the memory allocated for the conversion.
-		// 
-
-		ExFreePoolWithTag(AnsiMessage.Buffer, LOGGER_NT_POOL_TAG);
-
+			SerialWrite(InChunk, InLength);
+			return TRUE;
+		});
 	}
 
 	/// <summary>
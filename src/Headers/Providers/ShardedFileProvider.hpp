@@ -0,0 +1,969 @@
+#pragma once
+
+// 
+// The size of the buffer of every processor, and the interval at which the buffers are drained to the shard files.
+// 
+
+#define SHARDED_FILE_PROVIDER_DEFAULT_BUFFER_SIZE (64 * 1024)
+#define SHARDED_FILE_PROVIDER_DRAIN_INTERVAL 100
+
+// 
+// The longest format and encoded arguments stored as an event; longer messages are stored as text.
+// 
+
+#define SHARDED_FILE_PROVIDER_MAXIMUM_FORMAT_LENGTH 512
+#define SHARDED_FILE_PROVIDER_MAXIMUM_ARGUMENTS_LENGTH 512
+
+static_assert(SHARDED_FILE_PROVIDER_MAXIMUM_FORMAT_LENGTH <= LOG_SHARD_MAXIMUM_STRING_LENGTH, "The formats stored as events must fit in a definition record");
+static_assert(SHARDED_FILE_PROVIDER_MAXIMUM_ARGUMENTS_LENGTH <= LOG_SHARD_MAXIMUM_ARGUMENTS_LENGTH, "The arguments stored as events must fit in an event record");
+
+// 
+// The number of format strings a provider storing events can intern, the number of entries of their index which must
+// be a power of two, and the number of characters of the table holding their text.
+// 
+
+#define SHARDED_FILE_PROVIDER_MAXIMUM_STRINGS 1024
+#define SHARDED_FILE_PROVIDER_STRING_INDEX_CAPACITY 2048
+#define SHARDED_FILE_PROVIDER_STRING_TABLE_LENGTH (64 * 1024)
+
+static_assert(SHARDED_FILE_PROVIDER_MAXIMUM_STRINGS <= LOG_SHARD_MAXIMUM_STRINGS, "The identifiers of the format strings must be valid in a shard file");
+
+// 
+// The size of the buffer accumulating the records written to a shard file at once, which holds at least the longest record.
+// 
+
+#define SHARDED_FILE_PROVIDER_WRITE_BUFFER_SIZE (64 * 1024 + sizeof(LOG_SHARD_RECORD) + LOGGER_NT_MAXIMUM_MESSAGE_LENGTH * sizeof(WCHAR))
+
+/// <summary>
+/// The types of the entries of a processor buffer.
+/// </summary>
+enum class EShardedFileEntryType : USHORT
+{
+	/// <summary>
+	/// Fills the end of the buffer, when the next entry does not fit before it.
+	/// </summary>
+	Padding,
+
+	/// <summary>
+	/// A message stored as its format, null-terminated, followed by its encoded arguments.
+	/// </summary>
+	Event,
+
+	/// <summary>
+	/// A message stored already formatted, without null-terminator.
+	/// </summary>
+	Text,
+};
+
+/// <summary>
+/// The header of an entry of a processor buffer, aligned on its own size so a padding entry always fits.
+/// </summary>
+struct ShardedFileEntry
+{
+	/// <summary>
+	/// The total size of this entry, including this header and the alignment.
+	/// </summary>
+	ULONG Size;
+
+	/// <summary>
+	/// The type of this entry.
+	/// </summary>
+	EShardedFileEntryType Type;
+
+	/// <summary>
+	/// The severity.
+	/// </summary>
+	USHORT Level;
+
+	/// <summary>
+	/// The number of characters of the format, including its null-terminator, or zero for a text entry.
+	/// </summary>
+	ULONG FormatLength;
+
+	/// <summary>
+	/// The number of bytes following this header, without the alignment.
+	/// </summary>
+	ULONG PayloadLength;
+
+	/// <summary>
+	/// The system time the message was logged at.
+	/// </summary>
+	LONG64 Timestamp;
+
+	/// <summary>
+	/// The sequence number of the message, in the buffer of its processor.
+	/// </summary>
+	ULONG64 Sequence;
+};
+
+#define SHARDED_FILE_ENTRY_ALIGN_UP(Size) (((Size) + (sizeof(ShardedFileEntry) - 1)) & ~(sizeof(ShardedFileEntry) - 1))
+
+/// <summary>
+/// The buffer of a processor, only written by this processor and only read by the worker thread, followed by its entries.
+/// On machines with more processors than shards, the buffer is shared by several processors, which write it under its lock.
+/// The offsets only ever increase; an entry is at its offset modulo the size of the buffer, and never wraps around.
+/// </summary>
+struct ShardedFileBuffer
+{
+	/// <summary>
+	/// The offset of the next entry to write, published once the entry is complete.
+	/// </summary>
+	DECLSPEC_CACHEALIGN volatile LONG64 WriteOffset;
+
+	/// <summary>
+	/// Whether the buffer is written by several processors, which then hold the write lock.
+	/// </summary>
+	BOOLEAN IsShared;
+
+	/// <summary>
+	/// The lock serializing the processors writing to the buffer, only used if it is shared.
+	/// </summary>
+	KSPIN_LOCK WriteLock;
+
+	/// <summary>
+	/// The sequence number of the next entry to write.
+	/// </summary>
+	ULONG64 NextSequence;
+
+	/// <summary>
+	/// The number of messages dropped because the buffer was full.
+	/// </summary>
+	volatile LONG64 NumberOfDroppedEntries;
+
+	/// <summary>
+	/// The offset of the next entry to read, published once the entry is written to the shard file.
+	/// </summary>
+	DECLSPEC_CACHEALIGN volatile LONG64 ReadOffset;
+
+	/// <summary>
+	/// The number of dropped messages already reported in the shard file.
+	/// </summary>
+	LONG64 NumberOfReportedDrops;
+
+	/// <summary>
+	/// The timestamp of the last record written to the shard file.
+	/// </summary>
+	LONG64 LastTimestamp;
+
+	/// <summary>
+	/// The sequence number of the last record written to the shard file.
+	/// </summary>
+	ULONG64 LastSequence;
+
+	/// <summary>
+	/// A bit for every format string, set once it has been defined in the shard file.
+	/// </summary>
+	ULONG DefinedStrings[SHARDED_FILE_PROVIDER_MAXIMUM_STRINGS / 32];
+};
+
+/// <summary>
+/// An entry of the index of the format strings interned by a provider storing events.
+/// </summary>
+struct ShardedFileString
+{
+	/// <summary>
+	/// The hash of the format string, as computed by LogShardChecksum.
+	/// </summary>
+	ULONG Hash;
+
+	/// <summary>
+	/// The identifier of the format string.
+	/// </summary>
+	ULONG StringId;
+
+	/// <summary>
+	/// The offset of the format string in the string table, in characters.
+	/// </summary>
+	ULONG Offset;
+
+	/// <summary>
+	/// The number of characters of the format string, including its null-terminator, or zero for an empty entry.
+	/// </summary>
+	ULONG Length;
+};
+
+class ShardedFileProvider : public ILogEventProvider
+{
+private:
+
+	/// <summary>
+	/// The handles to the shard files saved on disk.
+	/// </summary>
+	HANDLE FileHandles[LOG_SHARD_MAXIMUM_SHARDS] = { };
+
+	/// <summary>
+	/// The buffer of every shard, drained to the shard of the same index.
+	/// </summary>
+	ShardedFileBuffer* Buffers[LOG_SHARD_MAXIMUM_SHARDS] = { };
+
+	/// <summary>
+	/// The number of shard files, one per processor up to LOG_SHARD_MAXIMUM_SHARDS.
+	/// </summary>
+	ULONG NumberOfShards = 0;
+
+	/// <summary>
+	/// The size of the entries area of every processor buffer, a power of two.
+	/// </summary>
+	ULONG BufferSize = 0;
+
+	/// <summary>
+	/// The worker thread draining the buffers to the shard files.
+	/// </summary>
+	PETHREAD WorkerThread = nullptr;
+
+	/// <summary>
+	/// The event signaled to stop the worker thread, after a last drain.
+	/// </summary>
+	KEVENT StopEvent = { };
+
+	/// <summary>
+	/// The event signaled when a buffer is more than half full, to drain the buffers before the interval elapses.
+	/// </summary>
+	KEVENT DrainEvent = { };
+
+	/// <summary>
+	/// The buffer of the worker thread, accumulating the records before they are written to a shard file.
+	/// </summary>
+	UCHAR* WriteBuffer = nullptr;
+
+	/// <summary>
+	/// The number of bytes used in the write buffer.
+	/// </summary>
+	ULONG WriteBufferLength = 0;
+
+	/// <summary>
+	/// The buffer of the worker thread, receiving the messages rendered from their format and arguments.
+	/// </summary>
+	WCHAR* RenderBuffer = nullptr;
+
+	/// <summary>
+	/// Whether messages are stored as event records referencing their format string, rather than as text records.
+	/// </summary>
+	BOOLEAN ShouldStoreEvents = FALSE;
+
+	/// <summary>
+	/// The index of the format strings interned by the worker thread, keyed by their contents.
+	/// </summary>
+	ShardedFileString* StringIndex = nullptr;
+
+	/// <summary>
+	/// The text of the format strings interned by the worker thread.
+	/// </summary>
+	WCHAR* StringTable = nullptr;
+
+	/// <summary>
+	/// The number of characters used in the string table.
+	/// </summary>
+	ULONG StringTableLength = 0;
+
+	/// <summary>
+	/// The number of format strings interned by the worker thread.
+	/// </summary>
+	ULONG NumberOfStrings = 0;
+
+	/// <summary>
+	/// The number of bytes written to the shard files.
+	/// </summary>
+	ULONG64 NumberOfBytesWritten = 0;
+
+public:
+
+	/// <summary>
+	/// Creates the shard files with the specified name, in the temporary folder for system components.
+	/// Every processor has its own shard, named after the filename followed by its index, e.g. 'Driver.003.shard', and
+	/// its own buffer, drained to the shard by a worker thread. Beyond LOG_SHARD_MAXIMUM_SHARDS processors, processors
+	/// share the shard and the buffer of their index modulo the number of shards. Messages logged while the buffer of
+	/// their processor is full are dropped, and their number is reported in the shard.
+	/// When storing events, the format of every message is written once to every shard, and the messages only hold
+	/// their arguments; messages which cannot be encoded, or whose format cannot be interned, are still stored as text.
+	/// Must be called at PASSIVE_LEVEL, before the provider is added to a logger.
+	/// </summary>
+	/// <param name="InFilename">The filename.</param>
+	/// <param name="InBufferSize">The size of the buffer of every processor.</param>
+	/// <param name="InShouldStoreEvents">Whether messages are stored as event records rather than as text records.</param>
+	NTSTATUS UseFilesNamed(CONST WCHAR* InFilename, ULONG InBufferSize = SHARDED_FILE_PROVIDER_DEFAULT_BUFFER_SIZE, BOOLEAN InShouldStoreEvents = FALSE)
+	{
+		// 
+		// If files were already open...
+		// 
+
+		this->Exit();
+
+		auto const NumberOfProcessors = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+		auto const NumberOfShards = min(NumberOfProcessors, (ULONG) LOG_SHARD_MAXIMUM_SHARDS);
+
+		// 
+		// Every buffer holds at least two of the largest entries, and has a size which is a power of two.
+		// 
+
+		auto const MaximumEntrySize = SHARDED_FILE_ENTRY_ALIGN_UP(sizeof(ShardedFileEntry) + max(SHARDED_FILE_PROVIDER_MAXIMUM_FORMAT_LENGTH * sizeof(WCHAR) + SHARDED_FILE_PROVIDER_MAXIMUM_ARGUMENTS_LENGTH, LOGGER_NT_MAXIMUM_MESSAGE_LENGTH * sizeof(WCHAR)));
+
+		this->BufferSize = PAGE_SIZE;
+
+		while (this->BufferSize < InBufferSize || this->BufferSize < MaximumEntrySize * 2)
+			this->BufferSize *= 2;
+
+		// 
+		// Allocate the buffers of the worker thread.
+		// 
+
+		this->WriteBuffer = (UCHAR*) ExAllocatePoolZero(NonPagedPoolNx, SHARDED_FILE_PROVIDER_WRITE_BUFFER_SIZE, LOGGER_NT_POOL_TAG);
+		this->RenderBuffer = (WCHAR*) ExAllocatePoolZero(NonPagedPoolNx, (LOGGER_NT_MAXIMUM_MESSAGE_LENGTH + 1) * sizeof(WCHAR), LOGGER_NT_POOL_TAG);
+
+		if (this->WriteBuffer == nullptr || this->RenderBuffer == nullptr)
+		{
+			this->Exit();
+			return STATUS_INSUFFICIENT_RESOURCES;
+		}
+
+		// 
+		// Allocate the string table, only used by the worker thread, when storing events.
+		// 
+
+		this->ShouldStoreEvents = InShouldStoreEvents;
+		this->NumberOfBytesWritten = 0;
+
+		if (InShouldStoreEvents)
+		{
+			this->StringIndex = (ShardedFileString*) ExAllocatePoolZero(NonPagedPoolNx, SHARDED_FILE_PROVIDER_STRING_INDEX_CAPACITY * sizeof(ShardedFileString), LOGGER_NT_POOL_TAG);
+			this->StringTable = (WCHAR*) ExAllocatePoolZero(NonPagedPoolNx, SHARDED_FILE_PROVIDER_STRING_TABLE_LENGTH * sizeof(WCHAR), LOGGER_NT_POOL_TAG);
+
+			if (this->StringIndex == nullptr || this->StringTable == nullptr)
+			{
+				this->Exit();
+				return STATUS_INSUFFICIENT_RESOURCES;
+			}
+		}
+
+		LOG_SHARD_HEADER Header = { };
+		Header.Magic = LOG_SHARD_MAGIC;
+		Header.Version = LOG_SHARD_VERSION;
+		Header.HeaderSize = sizeof(LOG_SHARD_HEADER);
+		Header.NumberOfShards = NumberOfShards;
+
+		LARGE_INTEGER CreationTime;
+		KeQuerySystemTimePrecise(&CreationTime);
+		Header.CreationTime = CreationTime.QuadPart;
+
+		for (ULONG ShardIdx = 0; ShardIdx < NumberOfShards; ++ShardIdx)
+		{
+			// 
+			// Allocate the buffer of the processor.
+			// 
+
+			this->Buffers[ShardIdx] = (ShardedFileBuffer*) ExAllocatePoolZero(NonPagedPoolNx, sizeof(ShardedFileBuffer) + this->BufferSize, LOGGER_NT_POOL_TAG);
+
+			if (this->Buffers[ShardIdx] == nullptr)
+			{
+				this->Exit();
+				return STATUS_INSUFFICIENT_RESOURCES;
+			}
+
+			// 
+			// The buffer is shared by the processors of the same index modulo the number of shards, if there are any.
+			// 
+
+			this->Buffers[ShardIdx]->IsShared = ShardIdx + NumberOfShards < NumberOfProcessors;
+			KeInitializeSpinLock(&this->Buffers[ShardIdx]->WriteLock);
+
+			// 
+			// Build the path to the shard, in the temporary system folder.
+			// 
+
+			WCHAR UnicodeFileNameBuffer[MAXIMUM_FILENAME_LENGTH] = { };
+			auto Status = RtlStringCchPrintfW(UnicodeFileNameBuffer, ARRAYSIZE(UnicodeFileNameBuffer), L"%ws%ws.%03lu.shard", wcschr(InFilename, L'\\') == nullptr ? L"\\SystemRoot\\Temp\\" : L"", InFilename, ShardIdx);
+
+			if (!NT_SUCCESS(Status))
+			{
+				this->Exit();
+				return Status;
+			}
+
+			UNICODE_STRING UnicodeFileName;
+			RtlInitUnicodeString(&UnicodeFileName, UnicodeFileNameBuffer);
+
+			// 
+			// Create the shard, replacing the one of a previous session.
+			// 
+
+			IO_STATUS_BLOCK IoStatusBlock = { };
+
+			OBJECT_ATTRIBUTES ObjectAttributes;
+			InitializeObjectAttributes(&ObjectAttributes, &UnicodeFileName, OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE, NULL, NULL);
+
+			Status = ZwCreateFile(&this->FileHandles[ShardIdx], FILE_APPEND_DATA | SYNCHRONIZE, &ObjectAttributes, &IoStatusBlock, NULL, FILE_ATTRIBUTE_NORMAL, FILE_SHARE_READ, FILE_OVERWRITE_IF, FILE_SYNCHRONOUS_IO_NONALERT | FILE_SEQUENTIAL_ONLY, NULL, 0);
+
+			if (NT_SUCCESS(Status))
+			{
+				Header.ShardIndex = ShardIdx;
+				Status = ZwWriteFile(this->FileHandles[ShardIdx], NULL, NULL, NULL, &IoStatusBlock, &Header, sizeof(Header), NULL, NULL);
+				this->NumberOfBytesWritten += sizeof(Header);
+			}
+
+			if (!NT_SUCCESS(Status))
+			{
+				this->Exit();
+				return Status;
+			}
+		}
+
+		this->NumberOfShards = NumberOfShards;
+
+		// 
+		// Create the worker thread, and keep a reference to it to wait for its termination.
+		// 
+
+		KeInitializeEvent(&this->StopEvent, NotificationEvent, FALSE);
+		KeInitializeEvent(&this->DrainEvent, SynchronizationEvent, FALSE);
+
+		HANDLE ThreadHandle;
+		OBJECT_ATTRIBUTES ObjectAttributes;
+		InitializeObjectAttributes(&ObjectAttributes, NULL, OBJ_KERNEL_HANDLE, NULL, NULL);
+
+		auto Status = PsCreateSystemThread(&ThreadHandle, THREAD_ALL_ACCESS, &ObjectAttributes, NULL, NULL, &ShardedFileProvider::WorkerRoutine, this);
+
+		if (!NT_SUCCESS(Status))
+		{
+			this->Exit();
+			return Status;
+		}
+
+		Status = ObReferenceObjectByHandle(ThreadHandle, THREAD_ALL_ACCESS, *PsThreadType, KernelMode, (PVOID*) &this->WorkerThread, NULL);
+
+		if (!NT_SUCCESS(Status))
+		{
+			// 
+			// Without a reference we cannot wait for it, so stop it right away.
+			// 
+
+			KeSetEvent(&this->StopEvent, IO_NO_INCREMENT, FALSE);
+			ZwWaitForSingleObject(ThreadHandle, FALSE, NULL);
+			ZwClose(ThreadHandle);
+			this->Exit();
+			return Status;
+		}
+
+		ZwClose(ThreadHandle);
+		return STATUS_SUCCESS;
+	}
+
+public:
+
+	/// <summary>
+	/// Logs a message to the buffer of the current processor, without formatting it nor waiting.
+	/// </summary>
+	/// <param name="InLevel">The severity.</param>
+	/// <param name="InFormat">The format of the message, which does not outlive the call.</param>
+	/// <param name="InArguments">The arguments for the message format.</param>
+	void LogEvent(ELogLevel InLevel, CONST WCHAR* InFormat, va_list InArguments) override
+	{
+		// 
+		// Stay on the current processor while writing to its buffer, so no other writer can ever touch it, unless it is
+		// shared with other processors.
+		// 
+
+		KIRQL OldIrql;
+		KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
+
+		if (auto const NumberOfShards = this->NumberOfShards; NumberOfShards != 0)
+		{
+			auto* Buffer = this->Buffers[KeGetCurrentProcessorIndex() % NumberOfShards];
+
+			if (Buffer->IsShared)
+			{
+				KeAcquireSpinLockAtDpcLevel(&Buffer->WriteLock);
+				this->Append(Buffer, InLevel, InFormat, InArguments);
+				KeReleaseSpinLockFromDpcLevel(&Buffer->WriteLock);
+			}
+			else
+			{
+				this->Append(Buffer, InLevel, InFormat, InArguments);
+			}
+		}
+
+		KeLowerIrql(OldIrql);
+	}
+
+private:
+
+	/// <summary>
+	/// Appends a message to the buffer of the current processor, or counts it as dropped if the buffer is full.
+	/// Must be called at DISPATCH_LEVEL, holding the write lock of the buffer if it is shared.
+	/// </summary>
+	/// <param name="InBuffer">The buffer of the current processor.</param>
+	/// <param name="InLevel">The severity.</param>
+	/// <param name="InFormat">The format of the message.</param>
+	/// <param name="InArguments">The arguments for the message format.</param>
+	void Append(ShardedFileBuffer* InBuffer, ELogLevel InLevel, CONST WCHAR* InFormat, va_list InArguments)
+	{
+		// 
+		// Encode the arguments on the stack first, so the size of the entry is known before it is reserved.
+		// 
+
+		UCHAR Arguments[SHARDED_FILE_PROVIDER_MAXIMUM_ARGUMENTS_LENGTH];
+		ULONG ArgumentsLength = 0;
+
+		auto const FormatLength = (ULONG) wcsnlen(InFormat, SHARDED_FILE_PROVIDER_MAXIMUM_FORMAT_LENGTH) + 1;
+
+		va_list EncodedArguments;
+		va_copy(EncodedArguments, InArguments);
+		auto const IsEvent = FormatLength <= SHARDED_FILE_PROVIDER_MAXIMUM_FORMAT_LENGTH && LogFormatEncode(InFormat, EncodedArguments, Arguments, sizeof(Arguments), &ArgumentsLength);
+		va_end(EncodedArguments);
+
+		// 
+		// Otherwise, the message is formatted right away, and truncated to the maximum length of a message.
+		// 
+
+		ULONG TextLength = 0;
+
+		if (!IsEvent)
+		{
+			va_list MeasuredArguments;
+			va_copy(MeasuredArguments, InArguments);
+			auto const Length = _vsnwprintf(nullptr, 0, InFormat, MeasuredArguments);
+			va_end(MeasuredArguments);
+
+			if (Length <= 0)
+				return;
+
+			TextLength = min((ULONG) Length, (ULONG) LOGGER_NT_MAXIMUM_MESSAGE_LENGTH);
+		}
+
+		auto const PayloadLength = IsEvent ? FormatLength * (ULONG) sizeof(WCHAR) + ArgumentsLength : TextLength * (ULONG) sizeof(WCHAR);
+		auto const EntrySize = (ULONG) SHARDED_FILE_ENTRY_ALIGN_UP(sizeof(ShardedFileEntry) + PayloadLength);
+
+		// 
+		// Reserve the entry, after a padding entry if it does not fit before the end of the buffer.
+		// 
+
+		auto* Entries = (UCHAR*) (InBuffer + 1);
+		auto Offset = InBuffer->WriteOffset;
+		auto const ReadOffset = ReadAcquire64(&InBuffer->ReadOffset);
+
+		auto const Position = (ULONG) (Offset & (this->BufferSize - 1));
+		auto const PaddingSize = Position + EntrySize > this->BufferSize ? this->BufferSize - Position : 0;
+
+		if (Offset + PaddingSize + EntrySize - ReadOffset > this->BufferSize)
+		{
+			WriteNoFence64(&InBuffer->NumberOfDroppedEntries, InBuffer->NumberOfDroppedEntries + 1);
+			return;
+		}
+
+		if (PaddingSize != 0)
+		{
+			auto* Padding = (ShardedFileEntry*) &Entries[Position];
+			Padding->Size = PaddingSize;
+			Padding->Type = EShardedFileEntryType::Padding;
+			Offset += PaddingSize;
+		}
+
+		// 
+		// Write the entry, then publish it to the worker thread.
+		// 
+
+		auto* Entry = (ShardedFileEntry*) &Entries[Offset & (this->BufferSize - 1)];
+		Entry->Size = EntrySize;
+		Entry->Type = IsEvent ? EShardedFileEntryType::Event : EShardedFileEntryType::Text;
+		Entry->Level = (USHORT) InLevel;
+		Entry->FormatLength = IsEvent ? FormatLength : 0;
+		Entry->PayloadLength = PayloadLength;
+		Entry->Sequence = InBuffer->NextSequence++;
+
+		LARGE_INTEGER Timestamp;
+		KeQuerySystemTimePrecise(&Timestamp);
+		Entry->Timestamp = Timestamp.QuadPart;
+
+		if (IsEvent)
+		{
+			RtlCopyMemory(Entry + 1, InFormat, FormatLength * sizeof(WCHAR));
+			RtlCopyMemory((WCHAR*) (Entry + 1) + FormatLength, Arguments, ArgumentsLength);
+		}
+		else
+		{
+			va_list FormattedArguments;
+			va_copy(FormattedArguments, InArguments);
+			_vsnwprintf((WCHAR*) (Entry + 1), TextLength, InFormat, FormattedArguments);
+			va_end(FormattedArguments);
+		}
+
+		WriteRelease64(&InBuffer->WriteOffset, Offset + EntrySize);
+
+		// 
+		// Wake the worker thread up once the buffer gets more than half full.
+		// 
+
+		auto const HalfSize = this->BufferSize / 2;
+
+		if (Offset - ReadOffset <= HalfSize && Offset + EntrySize - ReadOffset > HalfSize)
+			KeSetEvent(&this->DrainEvent, IO_NO_INCREMENT, FALSE);
+	}
+
+	/// <summary>
+	/// Writes the entries published to the buffer of a processor to its shard file, and reports the dropped messages.
+	/// Must be called by the worker thread.
+	/// </summary>
+	/// <param name="InShardIdx">The index of the shard.</param>
+	void Drain(ULONG InShardIdx)
+	{
+		auto* Buffer = this->Buffers[InShardIdx];
+		auto const* Entries = (CONST UCHAR*) (Buffer + 1);
+
+		auto const WriteOffset = ReadAcquire64(&Buffer->WriteOffset);
+		auto ReadOffset = Buffer->ReadOffset;
+
+		while (ReadOffset < WriteOffset)
+		{
+			auto const* Entry = (CONST ShardedFileEntry*) &Entries[ReadOffset & (this->BufferSize - 1)];
+			ReadOffset += Entry->Size;
+
+			if (Entry->Type == EShardedFileEntryType::Padding)
+				continue;
+
+			// 
+			// When storing events, only their arguments are written, after their format if the shard does not know it yet.
+			// 
+
+			CONST WCHAR* Message = (CONST WCHAR*) (Entry + 1);
+			SIZE_T MessageLength = Entry->PayloadLength / sizeof(WCHAR);
+
+			Buffer->LastTimestamp = Entry->Timestamp;
+			Buffer->LastSequence = Entry->Sequence;
+
+			if (Entry->Type == EShardedFileEntryType::Event && this->ShouldStoreEvents)
+			{
+				auto const StringId = this->Intern(Message, Entry->FormatLength);
+
+				if (StringId != MAXULONG)
+				{
+					if ((Buffer->DefinedStrings[StringId / 32] & (1UL << (StringId % 32))) == 0)
+					{
+						this->WriteString(InShardIdx, StringId, Message, Entry->FormatLength - 1);
+						Buffer->DefinedStrings[StringId / 32] |= 1UL << (StringId % 32);
+					}
+
+					this->WriteEvent(InShardIdx, (ELogLevel) Entry->Level, Entry->Timestamp, Entry->Sequence, StringId, (CONST UCHAR*) (Message + Entry->FormatLength), Entry->PayloadLength - Entry->FormatLength * sizeof(WCHAR));
+					continue;
+				}
+			}
+
+			// 
+			// Otherwise, events are rendered here, at PASSIVE_LEVEL, rather than on the processor which logged them.
+			// 
+
+			if (Entry->Type == EShardedFileEntryType::Event)
+			{
+				MessageLength = LogFormatRender(Message, (CONST UCHAR*) (Message + Entry->FormatLength), Entry->PayloadLength - Entry->FormatLength * sizeof(WCHAR), this->RenderBuffer, LOGGER_NT_MAXIMUM_MESSAGE_LENGTH + 1);
+				Message = this->RenderBuffer;
+			}
+
+			this->WriteRecord(InShardIdx, (ELogLevel) Entry->Level, Entry->Timestamp, Entry->Sequence, Message, MessageLength);
+		}
+
+		// 
+		// Release the space of the entries, before the shard file is even written to.
+		// 
+
+		WriteRelease64(&Buffer->ReadOffset, ReadOffset);
+
+		// 
+		// Report the messages dropped since the last drain, right after the last record so the shard stays ordered.
+		// 
+
+		auto const NumberOfDroppedEntries = ReadNoFence64(&Buffer->NumberOfDroppedEntries);
+
+		if (NumberOfDroppedEntries != Buffer->NumberOfReportedDrops)
+		{
+			auto const Length = _snwprintf(this->RenderBuffer, LOGGER_NT_MAXIMUM_MESSAGE_LENGTH, L"%lld messages were dropped, the buffer of the processor was full.", NumberOfDroppedEntries - Buffer->NumberOfReportedDrops);
+
+			if (Buffer->LastTimestamp == 0)
+			{
+				LARGE_INTEGER Timestamp;
+				KeQuerySystemTimePrecise(&Timestamp);
+				Buffer->LastTimestamp = Timestamp.QuadPart;
+			}
+
+			if (Length > 0)
+				this->WriteRecord(InShardIdx, ELogLevel::Warning, Buffer->LastTimestamp, Buffer->LastSequence, this->RenderBuffer, Length);
+
+			Buffer->NumberOfReportedDrops = NumberOfDroppedEntries;
+		}
+
+		this->FlushRecords(InShardIdx);
+	}
+
+	/// <summary>
+	/// Appends a record to the write buffer, after writing the buffer to the shard file if the record does not fit.
+	/// Must be called by the worker thread.
+	/// </summary>
+	/// <param name="InShardIdx">The index of the shard.</param>
+	/// <param name="InLevel">The severity.</param>
+	/// <param name="InTimestamp">The system time the message was logged at.</param>
+	/// <param name="InSequence">The sequence number of the message.</param>
+	/// <param name="InMessage">The message.</param>
+	/// <param name="InMessageLength">The number of characters of the message.</param>
+	void WriteRecord(ULONG InShardIdx, ELogLevel InLevel, LONG64 InTimestamp, ULONG64 InSequence, CONST WCHAR* InMessage, SIZE_T InMessageLength)
+	{
+		// 
+		// The break-line is not stored, the merge tool writes its own.
+		// 
+
+		if (InMessageLength != 0 && InMessage[InMessageLength - 1] == L'\n')
+			InMessageLength--;
+
+		if (InMessageLength > LOG_SHARD_MAXIMUM_MESSAGE_LENGTH)
+			InMessageLength = LOG_SHARD_MAXIMUM_MESSAGE_LENGTH;
+
+		auto const RecordSize = (ULONG) (sizeof(LOG_SHARD_RECORD) + InMessageLength * sizeof(WCHAR));
+
+		auto* Record = (LOG_SHARD_RECORD*) this->ReserveRecord(InShardIdx, RecordSize);
+		Record->Magic = LOG_SHARD_RECORD_MAGIC;
+		Record->Size = RecordSize;
+		Record->Timestamp = InTimestamp;
+		Record->Sequence = InSequence;
+		Record->Level = (ULONG) InLevel;
+		Record->ProcessorIndex = InShardIdx;
+		Record->MessageLength = (ULONG) InMessageLength;
+		Record->Checksum = LogShardChecksum(InMessage, InMessageLength * sizeof(WCHAR));
+
+		RtlCopyMemory(Record + 1, InMessage, InMessageLength * sizeof(WCHAR));
+	}
+
+	/// <summary>
+	/// Appends an event record to the write buffer, after writing the buffer to the shard file if the record does not fit.
+	/// Must be called by the worker thread.
+	/// </summary>
+	/// <param name="InShardIdx">The index of the shard.</param>
+	/// <param name="InLevel">The severity.</param>
+	/// <param name="InTimestamp">The system time the message was logged at.</param>
+	/// <param name="InSequence">The sequence number of the message.</param>
+	/// <param name="InStringId">The identifier of the format of the message, already defined in the shard.</param>
+	/// <param name="InArguments">The encoded arguments of the message.</param>
+	/// <param name="InArgumentsLength">The size of the encoded arguments, in bytes.</param>
+	void WriteEvent(ULONG InShardIdx, ELogLevel InLevel, LONG64 InTimestamp, ULONG64 InSequence, ULONG InStringId, CONST UCHAR* InArguments, SIZE_T InArgumentsLength)
+	{
+		auto const RecordSize = (ULONG) (sizeof(LOG_SHARD_EVENT) + InArgumentsLength);
+
+		auto* Event = (LOG_SHARD_EVENT*) this->ReserveRecord(InShardIdx, RecordSize);
+		Event->Magic = LOG_SHARD_EVENT_MAGIC;
+		Event->Size = RecordSize;
+		Event->Timestamp = InTimestamp;
+		Event->Sequence = InSequence;
+		Event->Level = (USHORT) InLevel;
+		Event->StringId = (USHORT) InStringId;
+		Event->Checksum = LogShardChecksum(InArguments, InArgumentsLength);
+
+		RtlCopyMemory(Event + 1, InArguments, InArgumentsLength);
+	}
+
+	/// <summary>
+	/// Appends a definition record to the write buffer, after writing the buffer to the shard file if the record does not fit.
+	/// Must be called by the worker thread.
+	/// </summary>
+	/// <param name="InShardIdx">The index of the shard.</param>
+	/// <param name="InStringId">The identifier of the format string.</param>
+	/// <param name="InFormat">The format string.</param>
+	/// <param name="InFormatLength">The number of characters of the format string, without its null-terminator.</param>
+	void WriteString(ULONG InShardIdx, ULONG InStringId, CONST WCHAR* InFormat, SIZE_T InFormatLength)
+	{
+		auto const RecordSize = (ULONG) (sizeof(LOG_SHARD_STRING) + InFormatLength * sizeof(WCHAR));
+
+		auto* String = (LOG_SHARD_STRING*) this->ReserveRecord(InShardIdx, RecordSize);
+		String->Magic = LOG_SHARD_STRING_MAGIC;
+		String->Size = RecordSize;
+		String->StringId = InStringId;
+		String->Checksum = LogShardChecksum(InFormat, InFormatLength * sizeof(WCHAR));
+
+		RtlCopyMemory(String + 1, InFormat, InFormatLength * sizeof(WCHAR));
+	}
+
+	/// <summary>
+	/// Reserves the space of a record at the end of the write buffer, after writing the buffer to the shard file if the record does not fit.
+	/// Must be called by the worker thread.
+	/// </summary>
+	/// <param name="InShardIdx">The index of the shard.</param>
+	/// <param name="InRecordSize">The total size of the record.</param>
+	/// <returns>The beginning of the record.</returns>
+	UCHAR* ReserveRecord(ULONG InShardIdx, ULONG InRecordSize)
+	{
+		if (this->WriteBufferLength + InRecordSize > SHARDED_FILE_PROVIDER_WRITE_BUFFER_SIZE)
+			this->FlushRecords(InShardIdx);
+
+		auto* Record = &this->WriteBuffer[this->WriteBufferLength];
+		this->WriteBufferLength += InRecordSize;
+		return Record;
+	}
+
+	/// <summary>
+	/// Returns the identifier of a format string, and interns it if needed.
+	/// Must be called by the worker thread.
+	/// </summary>
+	/// <param name="InFormat">The format string.</param>
+	/// <param name="InFormatLength">The number of characters of the format string, including its null-terminator.</param>
+	/// <returns>The identifier of the string, or MAXULONG if it cannot be interned.</returns>
+	ULONG Intern(CONST WCHAR* InFormat, ULONG InFormatLength)
+	{
+		// 
+		// Look the format string up by its contents, the buffers of the processors only hold copies of it.
+		// 
+
+		auto const Hash = LogShardChecksum(InFormat, InFormatLength * sizeof(WCHAR));
+		auto Slot = Hash & (SHARDED_FILE_PROVIDER_STRING_INDEX_CAPACITY - 1);
+
+		for (; this->StringIndex[Slot].Length != 0; Slot = (Slot + 1) & (SHARDED_FILE_PROVIDER_STRING_INDEX_CAPACITY - 1))
+		{
+			auto const& String = this->StringIndex[Slot];
+
+			if (String.Hash == Hash && String.Length == InFormatLength && RtlCompareMemory(&this->StringTable[String.Offset], InFormat, InFormatLength * sizeof(WCHAR)) == InFormatLength * sizeof(WCHAR))
+				return String.StringId;
+		}
+
+		// 
+		// Otherwise, copy it to the string table, unless it is full.
+		// 
+
+		if (this->NumberOfStrings == SHARDED_FILE_PROVIDER_MAXIMUM_STRINGS || SHARDED_FILE_PROVIDER_STRING_TABLE_LENGTH - this->StringTableLength < InFormatLength)
+			return MAXULONG;
+
+		auto& String = this->StringIndex[Slot];
+		String.Hash = Hash;
+		String.StringId = this->NumberOfStrings++;
+		String.Offset = this->StringTableLength;
+		String.Length = InFormatLength;
+
+		RtlCopyMemory(&this->StringTable[String.Offset], InFormat, InFormatLength * sizeof(WCHAR));
+		this->StringTableLength += InFormatLength;
+		return String.StringId;
+	}
+
+	/// <summary>
+	/// Appends the records of the write buffer to a shard file, without flushing it: a record torn by a crash is detected by the merge tool.
+	/// Must be called by the worker thread.
+	/// </summary>
+	/// <param name="InShardIdx">The index of the shard.</param>
+	void FlushRecords(ULONG InShardIdx)
+	{
+		if (this->WriteBufferLength == 0)
+			return;
+
+		IO_STATUS_BLOCK IoStatusBlock = { };
+		if (NT_SUCCESS(ZwWriteFile(this->FileHandles[InShardIdx], NULL, NULL, NULL, &IoStatusBlock, this->WriteBuffer, this->WriteBufferLength, NULL, NULL)))
+			this->NumberOfBytesWritten += this->WriteBufferLength;
+
+		this->WriteBufferLength = 0;
+	}
+
+	/// <summary>
+	/// The routine of the worker thread, draining every buffer periodically, or as soon as one gets more than half full.
+	/// </summary>
+	/// <param name="InContext">The provider.</param>
+	static void WorkerRoutine(PVOID InContext)
+	{
+		auto* Provider = (ShardedFileProvider*) InContext;
+
+		PVOID WaitObjects[] = { &Provider->StopEvent, &Provider->DrainEvent };
+
+		LARGE_INTEGER Interval;
+		Interval.QuadPart = -10000LL * SHARDED_FILE_PROVIDER_DRAIN_INTERVAL;
+
+		for (NTSTATUS Status = STATUS_TIMEOUT; Status != STATUS_WAIT_0; )
+		{
+			Status = KeWaitForMultipleObjects(ARRAYSIZE(WaitObjects), WaitObjects, WaitAny, Executive, KernelMode, FALSE, &Interval, NULL);
+
+			for (ULONG ShardIdx = 0; ShardIdx < Provider->NumberOfShards; ++ShardIdx)
+				Provider->Drain(ShardIdx);
+		}
+
+		PsTerminateSystemThread(STATUS_SUCCESS);
+	}
+
+public:
+
+	/// <summary>
+	/// Returns the number of bytes written to the shard files, including their headers.
+	/// Only stable once the provider has exited, as the worker thread keeps writing until then.
+	/// </summary>
+	ULONG64 GetNumberOfBytesWritten() CONST
+	{
+		return this->NumberOfBytesWritten;
+	}
+
+	/// <summary>
+	/// Returns the number of messages dropped because the buffer of their processor was full.
+	/// Only stable once the provider has exited, as processors keep logging until then.
+	/// </summary>
+	ULONG64 GetNumberOfDroppedMessages() CONST
+	{
+		ULONG64 NumberOfDroppedMessages = 0;
+
+		for (ULONG ShardIdx = 0; ShardIdx < ARRAYSIZE(this->Buffers); ++ShardIdx)
+		{
+			if (this->Buffers[ShardIdx] != nullptr)
+				NumberOfDroppedMessages += ReadNoFence64(&this->Buffers[ShardIdx]->NumberOfDroppedEntries);
+		}
+
+		return NumberOfDroppedMessages;
+	}
+
+	/// <summary>
+	/// Destroys this log provider, after writing the messages left in the buffers to the shard files.
+	/// Must be called at PASSIVE_LEVEL, once the provider does not receive messages anymore.
+	/// </summary>
+	void Exit() override
+	{
+		// 
+		// Stop the worker thread, which drains the buffers one last time.
+		// 
+
+		if (this->WorkerThread != nullptr)
+		{
+			KeSetEvent(&this->StopEvent, IO_NO_INCREMENT, FALSE);
+			KeWaitForSingleObject(this->WorkerThread, Executive, KernelMode, FALSE, NULL);
+			ObDereferenceObject(this->WorkerThread);
+			this->WorkerThread = nullptr;
+		}
+
+		this->NumberOfShards = 0;
+
+		// 
+		// Flush and close the handles which are still open, and release the buffers.
+		// 
+
+		for (ULONG ShardIdx = 0; ShardIdx < ARRAYSIZE(this->FileHandles); ++ShardIdx)
+		{
+			if (this->FileHandles[ShardIdx] != nullptr)
+			{
+				IO_STATUS_BLOCK IoStatusBlock = { };
+				ZwFlushBuffersFile(this->FileHandles[ShardIdx], &IoStatusBlock);
+				ZwClose(this->FileHandles[ShardIdx]);
+				this->FileHandles[ShardIdx] = nullptr;
+			}
+
+			if (this->Buffers[ShardIdx] != nullptr)
+			{
+				ExFreePoolWithTag(this->Buffers[ShardIdx], LOGGER_NT_POOL_TAG);
+				this->Buffers[ShardIdx] = nullptr;
+			}
+		}
+
+		if (this->WriteBuffer != nullptr)
+			ExFreePoolWithTag(this->WriteBuffer, LOGGER_NT_POOL_TAG);
+
+		if (this->RenderBuffer != nullptr)
+			ExFreePoolWithTag(this->RenderBuffer, LOGGER_NT_POOL_TAG);
+
+		if (this->StringIndex != nullptr)
+			ExFreePoolWithTag(this->StringIndex, LOGGER_NT_POOL_TAG);
+
+		if (this->StringTable != nullptr)
+			ExFreePoolWithTag(this->StringTable, LOGGER_NT_POOL_TAG);
+
+		this->WriteBuffer = nullptr;
+		this->WriteBufferLength = 0;
+		this->RenderBuffer = nullptr;
+		this->ShouldStoreEvents = FALSE;
+		this->StringIndex = nullptr;
+		this->StringTable = nullptr;
+		this->StringTableLength = 0;
+		this->NumberOfStrings = 0;
+	}
+};
@@ -63,11 +63,10 @@ public:
 public:
 	
 	/// <summary>
-	/// Logs a message of the specified severity.
+	/// Logs a record, made of its header and its message.
 	/// </summary>
-	/// <param name="InLogLevel">The severity.</param>
-	/// <param name="InMessage">The message.</param>
-	void Log(ELogLevel InLogLevel, CONST WCHAR* InMessage) override
+	/// <param name="InRecord">The record.</param>
+	void Log(CONST LogRecord& InRecord) override
 	{
 		// 
 		// If no file was selected, we cannot do anything.
@@ -85,43 +84,6 @@ public:
 		if (OldIrql > PASSIVE_LEVEL)
 			KeLowerIrql(PASSIVE_LEVEL);
 
-		// 
-		// Select the correct prefix for this log level.
-		// 
-
-		ANSI_STRING LevelPrefix;
-
-		switch (InLogLevel)
-		{
-			case ELogLevel::Trace:
-				RtlInitAnsiString(&LevelPrefix, " TRACE : ");
-				break;
-			
-			case ELogLevel::Debug:
-				RtlInitAnsiString(&LevelPrefix, " DEBUG : ");
-				break;
-			
-			case ELogLevel::Information:
-				RtlInitAnsiString(&LevelPrefix, "  INF  : ");
-				break;
-			
-			case ELogLevel::Warning:
-				RtlInitAnsiString(&LevelPrefix, "  WRN  : ");
-				break;
-			
-			case ELogLevel::Error:
-				RtlInitAnsiString(&LevelPrefix, " ERROR : ");
-				break;
-			
-			case ELogLevel::Fatal:
-				RtlInitAnsiString(&LevelPrefix, " FATAL : ");
-				break;
-
-			default:
-				RtlInitAnsiString(&LevelPrefix, "  UNK  : ");
-				break;
-		}
-
 		// 
 		// Make sure special kernel APCs that are queued will be executed.
 		// 
@@ -138,55 +100,40 @@ public:
 		if (this->ShouldStoreAsAnsi)
 		{
 			// 
-			// Convert the UNICODE string to a ANSI string.
+			// Convert the record to ANSI and write it to a file on disk a chunk at a time, the header starting the first one.
+			// As with UNICODE, the writing stops at the first chunk which could not be written, and the file is only flushed
+			// once the whole record was written.
 			// 
 
-			UNICODE_STRING UnicodeMessage;
-			UnicodeMessage.Buffer = (PWCH) InMessage;
-			UnicodeMessage.Length = (USHORT) wcslen(InMessage) * sizeof(WCHAR);
-			UnicodeMessage.MaximumLength = UnicodeMessage.Length + (1 * sizeof(WCHAR));
-			
-			ANSI_STRING AnsiMessage;
-			AnsiMessage.Buffer = (PCHAR) ExAllocatePoolZero(NonPagedPoolNx, UnicodeMessage.MaximumLength, LOGGER_NT_POOL_TAG);
-			AnsiMessage.Length = 0;
-			AnsiMessage.MaximumLength = UnicodeMessage.MaximumLength;
-			
-			if (NT_SUCCESS(RtlUnicodeStringToAnsiString(&AnsiMessage, &UnicodeMessage, false)))
-			{
-				// 
-				// Write the message to a file on disk.
-				// 
-
-				IO_STATUS_BLOCK IoStatusBlock = { };
-
-				if (NT_SUCCESS(ZwWriteFile(FileHandle, NULL, NULL, NULL, &IoStatusBlock, AnsiMessage.Buffer, AnsiMessage.Length, NULL, NULL)))
-					ZwFlushBuffersFile(FileHandle, &IoStatusBlock);
-			}
+			IO_STATUS_BLOCK IoStatusBlock = { };
 
-			// 
-			// Release the memory allocated for the conversion.
-			// 
+			auto const WasWritten = LogProviderConvertToAnsi(InRecord, [this, &IoStatusBlock] (CONST CHAR* InChunk, SIZE_T InLength) -> BOOLEAN
+			{
+				return NT_SUCCESS(ZwWriteFile(this->FileHandle, NULL, NULL, NULL, &IoStatusBlock, (PVOID) InChunk, (ULONG) InLength, NULL, NULL));
+			});
 
-			ExFreePoolWithTag(AnsiMessage.Buffer, LOGGER_NT_POOL_TAG);
+			if (WasWritten)
+				ZwFlushBuffersFile(FileHandle, &IoStatusBlock);
 		}
 		else
 		{
 			// 
-			// Calculate the length of message.
+			// Widen the header, which only contains ASCII characters.
 			// 
 
-			UNICODE_STRING UnicodeMessage;
-			UnicodeMessage.Buffer = (PWCH) InMessage;
-			UnicodeMessage.Length = (USHORT) wcslen(InMessage) * sizeof(WCHAR);
-			UnicodeMessage.MaximumLength = UnicodeMessage.Length + (1 * sizeof(WCHAR));
-			
+			WCHAR Header[LOG_RECORD_MAXIMUM_HEADER_LENGTH];
+
+			for (SIZE_T CharacterIdx = 0; CharacterIdx < InRecord.HeaderLength; ++CharacterIdx)
+				Header[CharacterIdx] = (WCHAR) InRecord.Header[CharacterIdx];
+
 			// 
-			// Write the message to a file on disk.
+			// Write the record to a file on disk, its length is not limited to what a UNICODE_STRING can describe.
 			// 
 
 			IO_STATUS_BLOCK IoStatusBlock = { };
 
-			if (NT_SUCCESS(ZwWriteFile(FileHandle, NULL, NULL, NULL, &IoStatusBlock, UnicodeMessage.Buffer, UnicodeMessage.Length, NULL, NULL)))
+			if (NT_SUCCESS(ZwWriteFile(FileHandle, NULL, NULL, NULL, &IoStatusBlock, Header, (ULONG) (InRecord.HeaderLength * sizeof(WCHAR)), NULL, NULL)) &&
+				NT_SUCCESS(ZwWriteFile(FileHandle, NULL, NULL, NULL, &IoStatusBlock, (PVOID) InRecord.Message, (ULONG) (InRecord.MessageLength * sizeof(WCHAR)), NULL, NULL)))
 				ZwFlushBuffersFile(FileHandle, &IoStatusBlock);
 		}
 
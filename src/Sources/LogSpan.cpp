@@ -0,0 +1,314 @@
+#include "../Headers/LoggerNT.h"
+using namespace LoggerNT;
+
+namespace LoggerNT
+{
+	/// <summary>
+	/// The list of sites which have recorded at least one span.
+	/// </summary>
+	LogSpanSite* volatile SpanSites = nullptr;
+
+	/// <summary>
+	/// The value of the cycle counter when the first site was registered.
+	/// </summary>
+	ULONG64 SpanCalibrationCycles = 0;
+
+	/// <summary>
+	/// The value of the performance counter when the first site was registered.
+	/// </summary>
+	LONG64 SpanCalibrationTicks = 0;
+}
+
+/// <summary>
+/// Allocates the table of the histograms of this site and adds it to the list of registered sites.
+/// Must be called at an IRQL lower or equal to DISPATCH_LEVEL.
+/// </summary>
+/// <returns>The table of the histograms of this site, or nullptr if it could not be allocated.</returns>
+LogSpanHistogram* volatile* LogSpanSite::Register()
+{
+	// 
+	// Allocate an entry for every processor which may ever be started, their histograms are only allocated once used.
+	// 
+
+	auto const NumberOfProcessors = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+	auto* NewHistograms = (LogSpanHistogram* volatile*) ExAllocatePoolZero(NonPagedPoolNx, NumberOfProcessors * sizeof(LogSpanHistogram*), LOGGER_NT_POOL_TAG);
+
+	if (NewHistograms == nullptr)
+		return nullptr;
+
+	// 
+	// Another processor may have registered this site in the meantime.
+	// 
+
+	this->NumberOfHistograms = NumberOfProcessors;
+
+	if (auto* CurrentHistograms = (LogSpanHistogram* volatile*) InterlockedCompareExchangePointer((PVOID*) &this->Histograms, (PVOID) NewHistograms, nullptr); CurrentHistograms != nullptr)
+	{
+		ExFreePoolWithTag((PVOID) NewHistograms, LOGGER_NT_POOL_TAG);
+		return CurrentHistograms;
+	}
+
+	// 
+	// Remember when the first site was registered, to convert cycles to nanoseconds when reporting.
+	// 
+
+	if (InterlockedCompareExchangePointer((PVOID*) &SpanSites, nullptr, nullptr) == nullptr && SpanCalibrationTicks == 0)
+	{
+		SpanCalibrationCycles = ReadTimeStampCounter();
+		SpanCalibrationTicks = KeQueryPerformanceCounter(nullptr).QuadPart;
+	}
+
+	// 
+	// Add this site to the list of registered sites.
+	// 
+
+	LogSpanSite* Head;
+
+	do
+	{
+		Head = SpanSites;
+		this->Next = Head;
+	}
+	while (InterlockedCompareExchangePointer((PVOID*) &SpanSites, this, Head) != Head);
+
+	return NewHistograms;
+}
+
+/// <summary>
+/// Allocates the histogram of this site for a processor.
+/// Must be called at an IRQL lower or equal to DISPATCH_LEVEL.
+/// </summary>
+/// <param name="InProcessorIndex">The index of the processor.</param>
+/// <returns>The histogram of the processor, or nullptr if it could not be allocated.</returns>
+LogSpanHistogram* LogSpanSite::AllocateHistogram(ULONG InProcessorIndex)
+{
+	// 
+	// Align the histogram on a cache line, so it never shares one with the histogram of another processor.
+	// 
+
+	auto* NewHistogram = (LogSpanHistogram*) ExAllocatePoolZero(NonPagedPoolNxCacheAligned, sizeof(LogSpanHistogram), LOGGER_NT_POOL_TAG);
+
+	if (NewHistogram == nullptr)
+		return nullptr;
+
+	// 
+	// A thread rescheduled from this processor may have allocated it in the meantime.
+	// 
+
+	if (auto* CurrentHistogram = (LogSpanHistogram*) InterlockedCompareExchangePointer((PVOID*) &this->Histograms[InProcessorIndex], NewHistogram, nullptr); CurrentHistogram != nullptr)
+	{
+		ExFreePoolWithTag(NewHistogram, LOGGER_NT_POOL_TAG);
+		return CurrentHistogram;
+	}
+
+	return NewHistogram;
+}
+
+/// <summary>
+/// Logs a summary of the durations recorded by every site: count, mean, 50th, 90th and 99th percentiles, and maximum.
+/// </summary>
+/// <param name="InLogger">The logger the summaries are reported to.</param>
+/// <param name="InShouldReset">Whether the histograms should be reset after being reported.</param>
+void LogSpanReport(Logger& InLogger, BOOLEAN InShouldReset)
+{
+	// 
+	// Measure the frequency of the cycle counter against the performance counter, since the first site was registered.
+	// 
+
+	LARGE_INTEGER Frequency;
+	auto const Ticks = KeQueryPerformanceCounter(&Frequency).QuadPart - SpanCalibrationTicks;
+	auto const Cycles = ReadTimeStampCounter() - SpanCalibrationCycles;
+	ULONG64 CyclesPerMicrosecond = 0;
+
+	if (SpanCalibrationTicks != 0 && Ticks >= Frequency.QuadPart / 1000)
+	{
+		auto const CyclesPerTick = Cycles / (ULONG64) Ticks;
+		auto const CyclesPerSecond = CyclesPerTick * Frequency.QuadPart + (Cycles % (ULONG64) Ticks) * Frequency.QuadPart / (ULONG64) Ticks;
+		CyclesPerMicrosecond = CyclesPerSecond / 1000000;
+	}
+
+	auto const ToReportedUnit = [CyclesPerMicrosecond] (ULONG64 InCycles) -> ULONG64
+	{
+		if (CyclesPerMicrosecond == 0)
+			return InCycles;
+
+		return (InCycles / CyclesPerMicrosecond) * 1000 + (InCycles % CyclesPerMicrosecond) * 1000 / CyclesPerMicrosecond;
+	};
+
+	auto const* Unit = CyclesPerMicrosecond != 0 ? L"ns" : L"cycles";
+
+	// 
+	// Merge the histograms of every processor, and summarize them.
+	// 
+
+	for (auto* Site = (LogSpanSite*) InterlockedCompareExchangePointer((PVOID*) &SpanSites, nullptr, nullptr); Site != nullptr; Site = Site->Next)
+	{
+		auto* PerProcessorHistograms = (LogSpanHistogram* volatile*) ReadPointerAcquire((PVOID*) &Site->Histograms);
+
+		if (PerProcessorHistograms == nullptr)
+			continue;
+
+		ULONG64 Counts[LOG_SPAN_BUCKETS] = { };
+		ULONG64 Count = 0;
+		ULONG64 TotalCycles = 0;
+
+		for (ULONG ProcessorIdx = 0; ProcessorIdx < Site->NumberOfHistograms; ++ProcessorIdx)
+		{
+			auto* ProcessorHistogram = (LogSpanHistogram*) ReadPointerAcquire((PVOID*) &PerProcessorHistograms[ProcessorIdx]);
+
+			if (ProcessorHistogram == nullptr)
+				continue;
+
+			auto& Histogram = *ProcessorHistogram;
+
+			for (ULONG BucketIdx = 0; BucketIdx < LOG_SPAN_BUCKETS; ++BucketIdx)
+			{
+				auto const BucketCount = (ULONG64) (InShouldReset ? InterlockedExchange64(&Histogram.Counts[BucketIdx], 0) : ReadNoFence64(&Histogram.Counts[BucketIdx]));
+				Counts[BucketIdx] += BucketCount;
+				Count += BucketCount;
+			}
+
+			TotalCycles += (ULONG64) (InShouldReset ? InterlockedExchange64(&Histogram.TotalCycles, 0) : ReadNoFence64(&Histogram.TotalCycles));
+		}
+
+		if (Count == 0)
+			continue;
+
+		// 
+		// Find the buckets holding the percentiles, and report their upper bound.
+		// 
+
+		ULONG64 Percentiles[3] = { };
+		CONST ULONG64 PercentilesPerMille[3] = { 500, 900, 990 };
+		ULONG64 Maximum = 0;
+		ULONG64 Cumulated = 0;
+		ULONG PercentileIdx = 0;
+
+		for (ULONG BucketIdx = 0; BucketIdx < LOG_SPAN_BUCKETS; ++BucketIdx)
+		{
+			if (Counts[BucketIdx] == 0)
+				continue;
+
+			Cumulated += Counts[BucketIdx];
+			Maximum = LogSpanGetBucketUpperBound(BucketIdx);
+
+			while (PercentileIdx < ARRAYSIZE(Percentiles) && Cumulated * 1000 >= Count * PercentilesPerMille[PercentileIdx])
+				Percentiles[PercentileIdx++] = Maximum;
+		}
+
+		InLogger.Info(L"[Span] %ws : count=%llu mean=%llu p50=%llu p90=%llu p99=%llu max=%llu (%ws)",
+			Site->Name,
+			Count,
+			ToReportedUnit(TotalCycles / Count),
+			ToReportedUnit(Percentiles[0]),
+			ToReportedUnit(Percentiles[1]),
+			ToReportedUnit(Percentiles[2]),
+			ToReportedUnit(Maximum),
+			Unit);
+	}
+}
+
+/// <summary>
+/// Releases the histograms of every site.
+/// Must be called once no span can be recorded anymore, typically when the driver is unloaded.
+/// </summary>
+void LogSpanExit()
+{
+	auto* Site = (LogSpanSite*) InterlockedExchangePointer((PVOID*) &SpanSites, nullptr);
+
+	while (Site != nullptr)
+	{
+		auto* NextSite = Site->Next;
+
+		if (auto* PerProcessorHistograms = (LogSpanHistogram* volatile*) InterlockedExchangePointer((PVOID*) &Site->Histograms, nullptr); PerProcessorHistograms != nullptr)
+		{
+			for (ULONG ProcessorIdx = 0; ProcessorIdx < Site->NumberOfHistograms; ++ProcessorIdx)
+			{
+				if (PerProcessorHistograms[ProcessorIdx] != nullptr)
+					ExFreePoolWithTag(PerProcessorHistograms[ProcessorIdx], LOGGER_NT_POOL_TAG);
+			}
+
+			ExFreePoolWithTag((PVOID) PerProcessorHistograms, LOGGER_NT_POOL_TAG);
+		}
+
+		Site->Next = nullptr;
+		Site = NextSite;
+	}
+
+	SpanCalibrationCycles = 0;
+	SpanCalibrationTicks = 0;
+}
+
+/// <summary>
+/// Starts reporting the summaries of every site periodically.
+/// Must be called at PASSIVE_LEVEL.
+/// </summary>
+/// <param name="InLogger">The logger the summaries are reported to.</param>
+/// <param name="InIntervalInMilliseconds">The interval between two reports.</param>
+NTSTATUS LogSpanReporter::Start(Logger& InLogger, ULONG InIntervalInMilliseconds)
+{
+	if (this->Thread != nullptr)
+		return STATUS_ALREADY_INITIALIZED;
+
+	this->Target = &InLogger;
+	this->Interval.QuadPart = -10000LL * InIntervalInMilliseconds;
+	KeInitializeEvent(&this->StopEvent, NotificationEvent, FALSE);
+
+	// 
+	// Create the reporting thread, and keep a reference to it to wait for its termination.
+	// 
+
+	HANDLE ThreadHandle;
+	OBJECT_ATTRIBUTES ObjectAttributes;
+	InitializeObjectAttributes(&ObjectAttributes, NULL, OBJ_KERNEL_HANDLE, NULL, NULL);
+
+	auto Status = PsCreateSystemThread(&ThreadHandle, THREAD_ALL_ACCESS, &ObjectAttributes, NULL, NULL, &LogSpanReporter::ThreadRoutine, this);
+
+	if (!NT_SUCCESS(Status))
+		return Status;
+
+	Status = ObReferenceObjectByHandle(ThreadHandle, THREAD_ALL_ACCESS, *PsThreadType, KernelMode, (PVOID*) &this->Thread, NULL);
+	ZwClose(ThreadHandle);
+
+	if (!NT_SUCCESS(Status))
+	{
+		// 
+		// Without a reference we cannot wait for it, so stop it right away.
+		// 
+
+		KeSetEvent(&this->StopEvent, IO_NO_INCREMENT, FALSE);
+		this->Thread = nullptr;
+	}
+
+	return Status;
+}
+
+/// <summary>
+/// Stops reporting, after a last report.
+/// Must be called at PASSIVE_LEVEL.
+/// </summary>
+void LogSpanReporter::Stop()
+{
+	if (this->Thread == nullptr)
+		return;
+
+	KeSetEvent(&this->StopEvent, IO_NO_INCREMENT, FALSE);
+	KeWaitForSingleObject(this->Thread, Executive, KernelMode, FALSE, NULL);
+	ObDereferenceObject(this->Thread);
+	this->Thread = nullptr;
+}
+
+/// <summary>
+/// The routine of the reporting thread.
+/// </summary>
+/// <param name="InContext">The reporter.</param>
+void LogSpanReporter::ThreadRoutine(PVOID InContext)
+{
+	auto* Reporter = (LogSpanReporter*) InContext;
+
+	while (KeWaitForSingleObject(&Reporter->StopEvent, Executive, KernelMode, FALSE, &Reporter->Interval) == STATUS_TIMEOUT)
+		LogSpanReport(*Reporter->Target, TRUE);
+
+	LogSpanReport(*Reporter->Target, TRUE);
+	PsTerminateSystemThread(STATUS_SUCCESS);
+}
@@ -2,82 +2,438 @@
 using namespace LoggerNT;
 
 /// <summary>
-/// Initializes the LoggerNT library.
+/// Initializes this logger.
 /// </summary>
 /// <param name="InConfig">The configuration.</param>
-NTSTATUS LogInitLibrary(CONST LoggerConfig& InConfig)
+NTSTATUS Logger::Init(CONST LoggerConfig& InConfig)
+{
+	if (this->IsSetup == FALSE)
+	{
+		KeInitializeSpinLock(&this->ProvidersLock);
+		KeInitializeSpinLock(&this->LogProcessingLock);
+		KeInitializeSpinLock(&this->ConfigLock);
+		this->IsSetup = TRUE;
+	}
+
+	return this->Reconfigure(InConfig);
+}
+
+/// <summary>
+/// Replaces the configuration of this logger, without pausing the logging on other processors.
+/// Messages being logged while the configuration is replaced use either the previous or the new one, never a mix of both.
+/// Must be called at an IRQL lower or equal to DISPATCH_LEVEL.
+/// </summary>
+/// <param name="InConfig">The new configuration.</param>
+NTSTATUS Logger::Reconfigure(CONST LoggerConfig& InConfig)
+{
+	// 
+	// Rewrite the slot following the active one, which no reader can be using anymore but the ones about to retry.
+	// 
+
+	KIRQL OldIrql;
+	KeAcquireSpinLock(&this->ConfigLock, &OldIrql);
+
+	auto const ActiveIndex = this->ActiveConfigIndex;
+	auto const NewIndex = (ActiveIndex + 1) % LOGGER_NT_NUMBER_OF_CONFIG_SNAPSHOTS;
+	auto& NewConfig = this->ConfigSnapshots[NewIndex];
+
+	// 
+	// Mark the slot as being rewritten before touching it, so the readers still copying it out copy it again.
+	// 
+
+	WriteNoFence64(&NewConfig.Sequence, NewConfig.Sequence + 1);
+	MemoryBarrier();
+
+	NewConfig.Version = this->ConfigSnapshots[ActiveIndex].Version + 1;
+	NewConfig.Config = InConfig;
+
+	// 
+	// Publish it in place of the current one, once it is complete.
+	// 
+
+	WriteRelease64(&NewConfig.Sequence, NewConfig.Sequence + 1);
+	WriteRelease(&this->ActiveConfigIndex, NewIndex);
+
+	KeReleaseSpinLock(&this->ConfigLock, OldIrql);
+	return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Gets a copy of the configuration currently used by this logger.
+/// </summary>
+LoggerConfig Logger::GetConfig()
+{
+	return this->ReadConfig();
+}
+
+/// <summary>
+/// Destroys the providers of this logger and releases its buffers.
+/// </summary>
+void Logger::Exit()
+{
+	// 
+	// Detach every event provider from this logger.
+	// 
+
+	KIRQL OldIrql;
+	KeAcquireSpinLock(&this->ProvidersLock, &OldIrql);
+
+	ILogEventProvider* DetachedEventProviders[ARRAYSIZE(this->EventProviders)] = { };
+	BOOLEAN WasEventProviderOwned[ARRAYSIZE(this->EventProviders)] = { };
+	LONG NumberOfDetachedEventProviders = this->NumberOfEventProviders;
+
+	for (LONG ProviderIdx = 0; ProviderIdx < NumberOfDetachedEventProviders; ++ProviderIdx)
+	{
+		DetachedEventProviders[ProviderIdx] = this->EventProviders[ProviderIdx];
+		WasEventProviderOwned[ProviderIdx] = this->IsEventProviderOwned[ProviderIdx];
+		InterlockedExchangePointer((PVOID*) &this->EventProviders[ProviderIdx], nullptr);
+		this->IsEventProviderOwned[ProviderIdx] = FALSE;
+	}
+
+	InterlockedExchange(&this->NumberOfEventProviders, 0);
+	KeReleaseSpinLock(&this->ProvidersLock, OldIrql);
+
+	// 
+	// Wait for the messages still being delivered to them by other processors, which never block, before destroying them.
+	// 
+
+	for (auto& Deliveries : this->EventDeliveries)
+	{
+		while (ReadAcquire(&Deliveries.Count) != 0)
+			YieldProcessor();
+	}
+
+	for (LONG ProviderIdx = 0; ProviderIdx < NumberOfDetachedEventProviders; ++ProviderIdx)
+	{
+		if (DetachedEventProviders[ProviderIdx] == nullptr)
+			continue;
+
+		DetachedEventProviders[ProviderIdx]->Exit();
+
+		if (WasEventProviderOwned[ProviderIdx])
+			ExFreePoolWithTag(DetachedEventProviders[ProviderIdx], LOGGER_NT_POOL_TAG);
+	}
+
+	// 
+	// Detach every provider from this logger, and destroy them.
+	// 
+
+	KeAcquireSpinLock(&this->ProvidersLock, &OldIrql);
+
+	ILogProvider* DetachedProviders[ARRAYSIZE(this->Providers)] = { };
+	BOOLEAN WasProviderOwned[ARRAYSIZE(this->Providers)] = { };
+	LONG NumberOfDetachedProviders = this->NumberOfProviders;
+
+	for (LONG ProviderIdx = 0; ProviderIdx < NumberOfDetachedProviders; ++ProviderIdx)
+	{
+		DetachedProviders[ProviderIdx] = this->Providers[ProviderIdx];
+		WasProviderOwned[ProviderIdx] = this->IsProviderOwned[ProviderIdx];
+		this->Providers[ProviderIdx] = nullptr;
+		this->IsProviderOwned[ProviderIdx] = FALSE;
+	}
+
+	InterlockedExchange(&this->NumberOfProviders, 0);
+	KeReleaseSpinLock(&this->ProvidersLock, OldIrql);
+
+	for (LONG ProviderIdx = 0; ProviderIdx < NumberOfDetachedProviders; ++ProviderIdx)
+	{
+		if (DetachedProviders[ProviderIdx] == nullptr)
+			continue;
+
+		DetachedProviders[ProviderIdx]->Exit();
+
+		if (WasProviderOwned[ProviderIdx])
+			ExFreePoolWithTag(DetachedProviders[ProviderIdx], LOGGER_NT_POOL_TAG);
+	}
+
+	// 
+	// Release the memory used for the formatting.
+	// 
+
+	KeAcquireSpinLock(&this->LogProcessingLock, &OldIrql);
+
+	if (this->LogProcessingBuffer != nullptr)
+		ExFreePoolWithTag(this->LogProcessingBuffer, LOGGER_NT_POOL_TAG);
+
+	this->LogProcessingBuffer = nullptr;
+	this->LogProcessBufferSize = 0;
+
+	auto* DetachedRing = this->Ring;
+	this->Ring = nullptr;
+	KeReleaseSpinLock(&this->LogProcessingLock, OldIrql);
+
+	// 
+	// Release the shared ring, now that nothing can write to it anymore.
+	// 
+
+	if (DetachedRing != nullptr)
+	{
+		DetachedRing->Exit();
+		ExFreePoolWithTag(DetachedRing, LOGGER_NT_POOL_TAG);
+	}
+
+	// 
+	// Restore the default configuration, in the slots of this logger which never need to be released.
+	// 
+
+	this->Reconfigure(LoggerConfig());
+}
+
+/// <summary>
+/// Enables the ring of records which can be mapped by user-mode consumers.
+/// Must be called at PASSIVE_LEVEL.
+/// </summary>
+/// <param name="InDataSize">The size of the data area of the ring.</param>
+/// <param name="InStringTableSize">The size of the table of interned format strings.</param>
+NTSTATUS Logger::EnableSharedRing(ULONG InDataSize, ULONG InStringTableSize)
 {
-	if (IsSetup == FALSE)
+	// 
+	// Allocate the ring before publishing it to the logging path.
+	// 
+
+	auto* NewRing = (LogRing*) ExAllocatePoolZero(NonPagedPoolNx, sizeof(LogRing), LOGGER_NT_POOL_TAG);
+
+	if (NewRing == nullptr)
+		return STATUS_INSUFFICIENT_RESOURCES;
+
+	NewRing = new(NewRing) LogRing();
+
+	if (auto const Status = NewRing->Init(InDataSize, InStringTableSize); !NT_SUCCESS(Status))
+	{
+		ExFreePoolWithTag(NewRing, LOGGER_NT_POOL_TAG);
+		return Status;
+	}
+
+	// 
+	// Publish the ring, unless another one was enabled in the meantime.
+	// 
+
+	KIRQL OldIrql;
+	KeAcquireSpinLock(&this->LogProcessingLock, &OldIrql);
+
+	auto const WasAlreadyEnabled = this->Ring != nullptr;
+
+	if (!WasAlreadyEnabled)
+		this->Ring = NewRing;
+
+	KeReleaseSpinLock(&this->LogProcessingLock, OldIrql);
+
+	if (WasAlreadyEnabled)
 	{
-		KeInitializeSpinLock(&ProvidersLock);
-		KeInitializeSpinLock(&LogProcessingLock);
-		IsSetup = TRUE;
+		NewRing->Exit();
+		ExFreePoolWithTag(NewRing, LOGGER_NT_POOL_TAG);
+		return STATUS_ALREADY_INITIALIZED;
 	}
 
-	Config = InConfig;
 	return STATUS_SUCCESS;
 }
 
+/// <summary>
+/// Discards the messages logged while no provider was registered, which will not be replayed anymore.
+/// </summary>
+void Logger::DiscardEarlyRecords()
+{
+	KIRQL OldIrql;
+	KeAcquireSpinLock(&this->LogProcessingLock, &OldIrql);
+	this->EarlyBufferLength = 0;
+	this->NumberOfDroppedEarlyRecords = 0;
+	KeReleaseSpinLock(&this->LogProcessingLock, OldIrql);
+}
+
+/// <summary>
+/// Adds an event provider to the list of event providers, after replaying the early messages to it.
+/// </summary>
+/// <param name="InProvider">The event provider.</param>
+/// <param name="InIsOwned">Whether the event provider was allocated by this logger.</param>
+BOOLEAN Logger::AddEventProvider(ILogEventProvider* InProvider, BOOLEAN InIsOwned)
+{
+	// 
+	// Both locks are held so no message can be delivered to it before the early ones, nor be both replayed and delivered.
+	// 
+
+	KIRQL OldIrql;
+	KeAcquireSpinLock(&this->LogProcessingLock, &OldIrql);
+	KeAcquireSpinLockAtDpcLevel(&this->ProvidersLock);
+
+	if (this->NumberOfEventProviders >= (LONG) ARRAYSIZE(this->EventProviders))
+	{
+		KeReleaseSpinLockFromDpcLevel(&this->ProvidersLock);
+		KeReleaseSpinLock(&this->LogProcessingLock, OldIrql);
+		return FALSE;
+	}
+
+	this->ReplayEarlyRecords(InProvider);
+	this->IsEventProviderOwned[this->NumberOfEventProviders] = InIsOwned;
+	InterlockedExchangePointer((PVOID*) &this->EventProviders[this->NumberOfEventProviders], InProvider);
+	InterlockedIncrement(&this->NumberOfEventProviders);
+	KeReleaseSpinLockFromDpcLevel(&this->ProvidersLock);
+	KeReleaseSpinLock(&this->LogProcessingLock, OldIrql);
+	return TRUE;
+}
+
+/// <summary>
+/// Delivers a message to every event provider, from the current processor and without taking any lock.
+/// </summary>
+/// <param name="InLogLevel">The severity.</param>
+/// <param name="InFormat">The format of the message.</param>
+/// <param name="InArguments">The arguments for the message format.</param>
+void Logger::DeliverEventv(ELogLevel InLogLevel, CONST WCHAR* InFormat, va_list InArguments)
+{
+	// 
+	// Stay on this processor while delivering, so its counter is only ever touched by the processors it is shared with.
+	// 
+
+	KIRQL OldIrql;
+	KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
+
+	auto& Deliveries = this->EventDeliveries[KeGetCurrentProcessorIndex() % ARRAYSIZE(this->EventDeliveries)];
+
+	// 
+	// The delivery is counted before the list is read, so the logger cannot destroy a provider it is delivering to.
+	// 
+
+	InterlockedIncrement(&Deliveries.Count);
+
+	auto const NumberOfEventProviders = ReadNoFence(&this->NumberOfEventProviders);
+
+	for (LONG ProviderIdx = 0; ProviderIdx < NumberOfEventProviders; ++ProviderIdx)
+	{
+		if (auto* Provider = (ILogEventProvider*) ReadPointerNoFence((PVOID*) &this->EventProviders[ProviderIdx]); Provider != nullptr)
+			Provider->LogEvent(InLogLevel, InFormat, InArguments);
+	}
+
+	InterlockedDecrement(&Deliveries.Count);
+	KeLowerIrql(OldIrql);
+}
+
+/// <summary>
+/// Delivers a message to every event provider, from the current processor and without taking any lock.
+/// </summary>
+/// <param name="InLogLevel">The severity.</param>
+/// <param name="InFormat">The format of the message.</param>
+/// <param name="...">The arguments for the message format.</param>
+void Logger::DeliverEvent(ELogLevel InLogLevel, CONST WCHAR* InFormat, ...)
+{
+	va_list Arguments;
+	va_start(Arguments, InFormat);
+	this->DeliverEventv(InLogLevel, InFormat, Arguments);
+	va_end(Arguments);
+}
+
 /// <summary>
 /// Logs a message of the specified log level.
 /// </summary>
 /// <param name="InLogLevel">The severity.</param>
 /// <param name="InFormat">The format of the message.</param>
 /// <param name="InArguments">The arguments for the message format.</param>
-void Logv(ELogLevel InLogLevel, CONST WCHAR* InFormat, va_list InArguments)
+void Logger::Logv(ELogLevel InLogLevel, CONST WCHAR* InFormat, va_list InArguments)
 {
 	// 
-	// Check whether this log should be processed or not.
+	// Check whether this log should be processed or not, the whole message being processed with the same configuration.
 	// 
 
+	auto const Config = this->ReadConfig();
+
 	if (InLogLevel < Config.MinimumLevel)
 		return;
-	
+
+	// 
+	// Event providers receive the message first, straight from this processor, without being serialized with the others.
+	// While it may be kept for the providers not registered yet, it is delivered under the lock instead, so an event
+	// provider being added either receives it now or has it replayed, never both.
+	// 
+
+	auto const HasProviders = ReadNoFence(&this->NumberOfProviders) != 0;
+	auto const IsDeliveredUnderLock = !HasProviders && Config.EnableEarlyBuffering;
+
+	if (!IsDeliveredUnderLock && ReadNoFence(&this->NumberOfEventProviders) != 0)
+		this->DeliverEventv(InLogLevel, InFormat, InArguments);
+
+	// 
+	// Without any provider, the message is only formatted when it is delivered, if it is ever delivered.
+	// 
+
+	if (!HasProviders && !Config.EnableEarlyBuffering && ReadPointerNoFence((PVOID*) &this->Ring) == nullptr)
+		return;
+
 	// 
 	// Calculate the number of bytes required for the formatting.
 	// 
 
-	auto const NumberOfCharactersRequired = _vsnwprintf(nullptr, 0, InFormat, InArguments);
+	auto NumberOfCharactersRequired = HasProviders ? _vsnwprintf(nullptr, 0, InFormat, InArguments) : 0;
 
-	if (NumberOfCharactersRequired <= 0)
+	if (HasProviders && NumberOfCharactersRequired <= 0)
 		return;
 
 	// 
-	// Lock the logger, and check if we already have allocated enough memory for the formatting.
+	// Lock the logger, and store the message in the shared ring, as its interned format string and its encoded arguments.
 	// 
 	
 	KIRQL OldIrql;
-	KeAcquireSpinLock(&LogProcessingLock, &OldIrql);
+	KeAcquireSpinLock(&this->LogProcessingLock, &OldIrql);
+
+	if (IsDeliveredUnderLock && this->NumberOfEventProviders != 0)
+		this->DeliverEventv(InLogLevel, InFormat, InArguments);
 
-	if (LogProcessingBuffer == nullptr ||
-		LogProcessBufferSize < (NumberOfCharactersRequired + 2) * sizeof(WCHAR))
+	if (this->Ring != nullptr)
+		this->Ring->WriteEvent(InLogLevel, InFormat, InArguments);
+
+	// 
+	// Keep the message for the providers which are not registered yet.
+	// 
+
+	if (this->NumberOfProviders == 0)
 	{
-		if (LogProcessingBuffer != nullptr)
-			ExFreePoolWithTag(LogProcessingBuffer, LOGGER_NT_POOL_TAG);
-		
-		LogProcessBufferSize = (NumberOfCharactersRequired + 2) * sizeof(WCHAR);
-		LogProcessingBuffer = (WCHAR*) ExAllocatePoolZero(NonPagedPoolNx, LogProcessBufferSize, LOGGER_NT_POOL_TAG);
+		if (Config.EnableEarlyBuffering)
+			this->StoreEarlyRecordv(InLogLevel, InFormat, InArguments);
 
-		if (LogProcessingBuffer == nullptr)
-		{
-			// 
-			// We don't have enough memory on the system.
-			// 
+		KeReleaseSpinLock(&this->LogProcessingLock, OldIrql);
+		return;
+	}
 
-			LogProcessBufferSize = 0;
-			LogProcessingBuffer = nullptr;
-			KeReleaseSpinLock(&LogProcessingLock, OldIrql);
-			return;
-		}
+	// 
+	// A provider may have been registered after the number of providers was read.
+	// 
+
+	if (!HasProviders && (NumberOfCharactersRequired = _vsnwprintf(nullptr, 0, InFormat, InArguments)) <= 0)
+	{
+		KeReleaseSpinLock(&this->LogProcessingLock, OldIrql);
+		return;
+	}
+
+	// 
+	// Messages longer than the maximum length are truncated, so the buffer never grows past it.
+	// 
+
+	auto const IsTruncated = NumberOfCharactersRequired > LOGGER_NT_MAXIMUM_MESSAGE_LENGTH;
+
+	if (IsTruncated)
+		NumberOfCharactersRequired = LOGGER_NT_MAXIMUM_MESSAGE_LENGTH;
+
+	// 
+	// Check if we already have allocated enough memory for the formatting.
+	// 
+
+	if (!this->ReserveProcessingBuffer(NumberOfCharactersRequired + 2))
+	{
+		KeReleaseSpinLock(&this->LogProcessingLock, OldIrql);
+		return;
 	}
 
 	// 
-	// Format the message and the arguments.
+	// Format the message and the arguments, and mark the truncated messages as such.
 	// 
 
-	if (vswprintf_s(LogProcessingBuffer, LogProcessBufferSize / sizeof(*InFormat), InFormat, InArguments) <= 0)
+	if (IsTruncated)
 	{
-		KeReleaseSpinLock(&LogProcessingLock, OldIrql);
+		CONST WCHAR TruncationMarker[] = L" [truncated]";
+
+		_vsnwprintf(this->LogProcessingBuffer, NumberOfCharactersRequired, InFormat, InArguments);
+		RtlCopyMemory(&this->LogProcessingBuffer[NumberOfCharactersRequired - (ARRAYSIZE(TruncationMarker) - 1)], TruncationMarker, sizeof(TruncationMarker) - sizeof(WCHAR));
+	}
+	else if (vswprintf_s(this->LogProcessingBuffer, this->LogProcessBufferSize / sizeof(*InFormat), InFormat, InArguments) <= 0)
+	{
+		KeReleaseSpinLock(&this->LogProcessingLock, OldIrql);
 		return;
 	}
 
@@ -85,23 +441,522 @@ void Logv(ELogLevel InLogLevel, CONST WCHAR* InFormat, va_list InArguments)
 	// Append a break-line at the end of the message.
 	// 
 
-	LogProcessingBuffer[NumberOfCharactersRequired] = L'\n';
-	LogProcessingBuffer[NumberOfCharactersRequired + 1] = L'\0';
+	this->LogProcessingBuffer[NumberOfCharactersRequired] = L'\n';
+	this->LogProcessingBuffer[NumberOfCharactersRequired + 1] = L'\0';
 	
 	// 
-	// Log the message.
+	// Render the header once, and log the record.
 	// 
+
+	auto const Record = this->MakeRecord(Config, InLogLevel, this->LogProcessingBuffer, NumberOfCharactersRequired + 1);
 	
-	KeAcquireSpinLockAtDpcLevel(&ProvidersLock);
+	KeAcquireSpinLockAtDpcLevel(&this->ProvidersLock);
 
-	for (LONG ProviderIdx = 0; ProviderIdx < NumberOfProviders; ++ProviderIdx)
+	for (LONG ProviderIdx = 0; ProviderIdx < this->NumberOfProviders; ++ProviderIdx)
 	{
-		if (auto* Provider = Providers[ProviderIdx]; Provider != nullptr)
-			Provider->Log(InLogLevel, LogProcessingBuffer);
+		if (auto* Provider = this->Providers[ProviderIdx]; Provider != nullptr)
+			Provider->Log(Record);
 	}
 
-	KeReleaseSpinLockFromDpcLevel(&ProvidersLock),
-	KeReleaseSpinLock(&LogProcessingLock, OldIrql);
+	KeReleaseSpinLockFromDpcLevel(&this->ProvidersLock);
+	KeReleaseSpinLock(&this->LogProcessingLock, OldIrql);
+}
+
+/// <summary>
+/// Logs a binary payload as a hexadecimal dump, streamed in chunks of bounded size.
+/// The chunks are not atomic with each other: other messages, including the lines of other dumps, may be logged between
+/// two chunks. Every line starts with its offset in the payload.
+/// </summary>
+/// <param name="InLogLevel">The severity.</param>
+/// <param name="InTitle">The title of the dump.</param>
+/// <param name="InData">The payload.</param>
+/// <param name="InSize">The size of the payload.</param>
+void Logger::HexDump(ELogLevel InLogLevel, CONST WCHAR* InTitle, CONST VOID* InData, SIZE_T InSize)
+{
+	// 
+	// Check whether this dump should be processed or not.
+	// 
+
+	auto const Config = this->ReadConfig();
+
+	if (InLogLevel < Config.MinimumLevel)
+		return;
+
+	if (ReadNoFence(&this->NumberOfProviders) == 0 && ReadNoFence(&this->NumberOfEventProviders) == 0 && !Config.EnableEarlyBuffering && ReadPointerNoFence((PVOID*) &this->Ring) == nullptr)
+		return;
+
+	// 
+	// Log the title as a regular message, so it is interned by the shared ring.
+	// 
+
+	this->Log(InLogLevel, L"%ws (%Iu bytes)", InTitle, InSize);
+
+	// 
+	// Render and log the payload a chunk at a time, releasing the lock in-between so a large dump does not hold it for long.
+	// 
+
+	auto const IsWideOffset = (ULONG64) InSize > MAXULONG;
+
+	for (SIZE_T Offset = 0; Offset < InSize; Offset += LOG_HEX_DUMP_BYTES_PER_CHUNK)
+	{
+		auto const ChunkSize = min(InSize - Offset, (SIZE_T) LOG_HEX_DUMP_BYTES_PER_CHUNK);
+
+		// 
+		// Event providers receive the chunk a line at a time, rendered on the stack so the lock is not needed, unless the
+		// chunk may be kept for the providers not registered yet, as in Logv.
+		// 
+
+		auto const DeliverLines = [&] ()
+		{
+			for (SIZE_T LineOffset = 0; LineOffset < ChunkSize; LineOffset += LOG_HEX_DUMP_BYTES_PER_LINE)
+			{
+				WCHAR Line[LOG_HEX_DUMP_MAXIMUM_LINE_LENGTH + 1];
+				auto const LineLength = LogHexDumpRenderLine((CONST UCHAR*) InData + Offset + LineOffset, min(ChunkSize - LineOffset, (SIZE_T) LOG_HEX_DUMP_BYTES_PER_LINE), Offset + LineOffset, IsWideOffset, Line);
+
+				Line[LineLength - 1] = L'\0';
+				this->DeliverEvent(InLogLevel, L"%ws", Line);
+			}
+		};
+
+		auto const IsDeliveredUnderLock = ReadNoFence(&this->NumberOfProviders) == 0 && Config.EnableEarlyBuffering;
+
+		if (!IsDeliveredUnderLock && ReadNoFence(&this->NumberOfEventProviders) != 0)
+			DeliverLines();
+
+		KIRQL OldIrql;
+		KeAcquireSpinLock(&this->LogProcessingLock, &OldIrql);
+
+		if (IsDeliveredUnderLock && this->NumberOfEventProviders != 0)
+			DeliverLines();
+
+		if (!this->ReserveProcessingBuffer(LOG_HEX_DUMP_MAXIMUM_CHUNK_LENGTH + 1))
+		{
+			KeReleaseSpinLock(&this->LogProcessingLock, OldIrql);
+			return;
+		}
+
+		auto const Length = LogHexDumpRenderChunk((CONST UCHAR*) InData + Offset, ChunkSize, Offset, IsWideOffset, this->LogProcessingBuffer);
+
+		// 
+		// The shared ring and the early buffer store the chunk without its last break-line, as any other message.
+		// 
+
+		if (this->Ring != nullptr)
+			this->Ring->Write(InLogLevel, this->LogProcessingBuffer, Length - 1);
+
+		if (this->NumberOfProviders == 0)
+		{
+			if (Config.EnableEarlyBuffering)
+			{
+				this->LogProcessingBuffer[Length - 1] = L'\0';
+				this->StoreEarlyRecord(InLogLevel, L"%ws", this->LogProcessingBuffer);
+			}
+
+			KeReleaseSpinLock(&this->LogProcessingLock, OldIrql);
+			continue;
+		}
+
+		auto const Record = this->MakeRecord(Config, InLogLevel, this->LogProcessingBuffer, Length);
+
+		KeAcquireSpinLockAtDpcLevel(&this->ProvidersLock);
+
+		for (LONG ProviderIdx = 0; ProviderIdx < this->NumberOfProviders; ++ProviderIdx)
+		{
+			if (auto* Provider = this->Providers[ProviderIdx]; Provider != nullptr)
+				Provider->Log(Record);
+		}
+
+		KeReleaseSpinLockFromDpcLevel(&this->ProvidersLock);
+		KeReleaseSpinLock(&this->LogProcessingLock, OldIrql);
+	}
+}
+
+/// <summary>
+/// Makes sure the buffer used to store the formatted output can hold the specified number of characters.
+/// Must be called with the log processing lock held.
+/// </summary>
+/// <param name="InNumberOfCharacters">The number of characters, including the break-line and the null-terminator.</param>
+BOOLEAN Logger::ReserveProcessingBuffer(SIZE_T InNumberOfCharacters)
+{
+	if (this->LogProcessingBuffer != nullptr &&
+		this->LogProcessBufferSize >= InNumberOfCharacters * sizeof(WCHAR))
+		return TRUE;
+
+	if (this->LogProcessingBuffer != nullptr)
+		ExFreePoolWithTag(this->LogProcessingBuffer, LOGGER_NT_POOL_TAG);
+	
+	this->LogProcessBufferSize = InNumberOfCharacters * sizeof(WCHAR);
+	this->LogProcessingBuffer = (WCHAR*) ExAllocatePoolZero(NonPagedPoolNx, this->LogProcessBufferSize, LOGGER_NT_POOL_TAG);
+
+	if (this->LogProcessingBuffer == nullptr)
+	{
+		// 
+		// We don't have enough memory on the system.
+		// 
+
+		this->LogProcessBufferSize = 0;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/// <summary>
+/// Gets a copy of the configuration currently used by this logger, without taking any lock.
+/// </summary>
+LoggerConfig Logger::ReadConfig()
+{
+	for (;;)
+	{
+		auto const& Snapshot = this->ConfigSnapshots[ReadAcquire(&this->ActiveConfigIndex)];
+		auto const Sequence = ReadAcquire64(&Snapshot.Sequence);
+
+		// 
+		// The copy is only consistent if the slot was not being rewritten, and was not rewritten while it was copied.
+		// 
+
+		if ((Sequence & 1) == 0)
+		{
+			auto const Config = Snapshot.Config;
+			MemoryBarrier();
+
+			if (ReadNoFence64(&Snapshot.Sequence) == Sequence)
+				return Config;
+		}
+
+		YieldProcessor();
+	}
+}
+
+/// <summary>
+/// Renders the header of a record into the header buffer, as configured.
+/// Must be called with the log processing lock held.
+/// </summary>
+/// <param name="InConfig">The configuration the header is rendered with.</param>
+/// <param name="InLogLevel">The severity.</param>
+/// <param name="InMessage">The message, ending with a break-line.</param>
+/// <param name="InMessageLength">The number of characters of the message, including the break-line.</param>
+/// <param name="InTimestamp">The time the message was logged at, or nullptr if it was logged now.</param>
+/// <param name="InProcessorIndex">The index of the processor the message was logged from, or MAXULONG if it is the current one.</param>
+LogRecord Logger::MakeRecord(CONST LoggerConfig& InConfig, ELogLevel InLogLevel, CONST WCHAR* InMessage, SIZE_T InMessageLength, OPTIONAL CONST LARGE_INTEGER* InTimestamp, ULONG InProcessorIndex)
+{
+	LogRecord Record;
+	Record.Level = InLogLevel;
+	Record.ProcessorIndex = InProcessorIndex != MAXULONG ? InProcessorIndex : KeGetCurrentProcessorIndex();
+	Record.Sequence = this->NextSequence++;
+
+	if (InTimestamp != nullptr)
+		Record.Timestamp = *InTimestamp;
+	else
+		KeQuerySystemTimePrecise(&Record.Timestamp);
+
+	TIME_FIELDS Time = { };
+
+	if (InConfig.ShouldPrefixTimestamp)
+	{
+		LARGE_INTEGER LocalTime;
+		ExSystemTimeToLocalTime(&Record.Timestamp, &LocalTime);
+		RtlTimeToTimeFields(&LocalTime, &Time);
+	}
+
+	Record.Header = this->HeaderBuffer;
+	Record.HeaderLength = LogRecordRenderHeader(this->HeaderBuffer, InLogLevel, InConfig.ShouldPrefixTimestamp ? &Time : nullptr, InConfig.ShouldPrefixProcessor ? Record.ProcessorIndex : MAXULONG);
+	Record.Message = InMessage;
+	Record.MessageLength = InMessageLength;
+	return Record;
+}
+
+/// <summary>
+/// Stores a message in the early buffer, without formatting it.
+/// Must be called with the log processing lock held.
+/// </summary>
+/// <param name="InLogLevel">The severity.</param>
+/// <param name="InFormat">The format of the message.</param>
+/// <param name="InArguments">The arguments for the message format.</param>
+void Logger::StoreEarlyRecordv(ELogLevel InLogLevel, CONST WCHAR* InFormat, va_list InArguments)
+{
+	auto const RemainingSize = (ULONG) sizeof(this->EarlyBuffer) - this->EarlyBufferLength;
+
+	if (RemainingSize < sizeof(LoggerEarlyRecord))
+	{
+		this->NumberOfDroppedEarlyRecords++;
+		return;
+	}
+
+	// 
+	// Copy the format right after the header of the record, as it may not outlive the call, e.g. if it was built on the stack.
+	// 
+
+	auto* Record = (LoggerEarlyRecord*) &this->EarlyBuffer[this->EarlyBufferLength];
+	auto* Format = (WCHAR*) (Record + 1);
+
+	auto const FormatCapacity = (RemainingSize - (ULONG) sizeof(LoggerEarlyRecord)) / sizeof(WCHAR);
+	auto const FormatLength = (ULONG) wcsnlen(InFormat, FormatCapacity) + 1;
+
+	if (FormatLength > FormatCapacity)
+	{
+		this->NumberOfDroppedEarlyRecords++;
+		return;
+	}
+
+	RtlCopyMemory(Format, InFormat, FormatLength * sizeof(WCHAR));
+
+	// 
+	// Encode the arguments right after the format.
+	// 
+
+	va_list Arguments;
+	va_copy(Arguments, InArguments);
+
+	ULONG ArgumentsLength = 0;
+	auto const WasEncoded = LogFormatEncode(InFormat, Arguments, (UCHAR*) (Format + FormatLength), RemainingSize - sizeof(LoggerEarlyRecord) - FormatLength * sizeof(WCHAR), &ArgumentsLength);
+	va_end(Arguments);
+
+	if (!WasEncoded)
+	{
+		this->NumberOfDroppedEarlyRecords++;
+		return;
+	}
+
+	Record->Size = min((ULONG) LOG_RING_ALIGN_UP(sizeof(LoggerEarlyRecord) + FormatLength * sizeof(WCHAR) + ArgumentsLength), RemainingSize);
+	Record->FormatLength = FormatLength;
+	Record->ArgumentsLength = ArgumentsLength;
+	Record->Level = InLogLevel;
+	Record->ProcessorIndex = KeGetCurrentProcessorIndex();
+	KeQuerySystemTimePrecise(&Record->Timestamp);
+
+	this->EarlyBufferLength += Record->Size;
+}
+
+/// <summary>
+/// Stores a message in the early buffer, without formatting it.
+/// Must be called with the log processing lock held.
+/// </summary>
+/// <param name="InLogLevel">The severity.</param>
+/// <param name="InFormat">The format of the message.</param>
+/// <param name="...">The arguments for the message format.</param>
+void Logger::StoreEarlyRecord(ELogLevel InLogLevel, CONST WCHAR* InFormat, ...)
+{
+	va_list Arguments;
+	va_start(Arguments, InFormat);
+	this->StoreEarlyRecordv(InLogLevel, InFormat, Arguments);
+	va_end(Arguments);
+}
+
+/// <summary>
+/// Formats the messages stored in the early buffer, and logs them to a single provider, in order.
+/// Must be called with the log processing lock held.
+/// </summary>
+/// <param name="InProvider">The provider.</param>
+void Logger::ReplayEarlyRecords(ILogProvider* InProvider)
+{
+	if (this->EarlyBufferLength == 0 && this->NumberOfDroppedEarlyRecords == 0)
+		return;
+
+	if (!this->ReserveProcessingBuffer(LOGGER_NT_MAXIMUM_MESSAGE_LENGTH + 2))
+		return;
+
+	auto const Config = this->ReadConfig();
+
+	for (ULONG Offset = 0; Offset < this->EarlyBufferLength; )
+	{
+		auto const* EarlyRecord = (CONST LoggerEarlyRecord*) &this->EarlyBuffer[Offset];
+		Offset += EarlyRecord->Size;
+
+		// 
+		// Format the message, append a break-line at the end of it, and render its header as of when it was logged.
+		// 
+
+		auto const* Format = (CONST WCHAR*) (EarlyRecord + 1);
+		auto const Length = LogFormatRender(Format, (CONST UCHAR*) (Format + EarlyRecord->FormatLength), EarlyRecord->ArgumentsLength, this->LogProcessingBuffer, LOGGER_NT_MAXIMUM_MESSAGE_LENGTH + 1);
+
+		this->LogProcessingBuffer[Length] = L'\n';
+		this->LogProcessingBuffer[Length + 1] = L'\0';
+		InProvider->Log(this->MakeRecord(Config, EarlyRecord->Level, this->LogProcessingBuffer, Length + 1, &EarlyRecord->Timestamp, EarlyRecord->ProcessorIndex));
+	}
+
+	if (this->NumberOfDroppedEarlyRecords != 0)
+	{
+		auto Length = _snwprintf(this->LogProcessingBuffer, LOGGER_NT_MAXIMUM_MESSAGE_LENGTH, L"%lu early messages could not be stored and were dropped.\n", this->NumberOfDroppedEarlyRecords);
+
+		if (Length < 0)
+			Length = LOGGER_NT_MAXIMUM_MESSAGE_LENGTH;
+
+		this->LogProcessingBuffer[Length] = L'\0';
+		InProvider->Log(this->MakeRecord(Config, ELogLevel::Warning, this->LogProcessingBuffer, Length));
+	}
+}
+
+/// <summary>
+/// Formats the messages stored in the early buffer, and delivers them to a single event provider, in order.
+/// The event provider receives them as already formatted messages, stamped with the time they are replayed at.
+/// Must be called with the log processing lock held.
+/// </summary>
+/// <param name="InProvider">The event provider.</param>
+void Logger::ReplayEarlyRecords(ILogEventProvider* InProvider)
+{
+	if (this->EarlyBufferLength == 0 && this->NumberOfDroppedEarlyRecords == 0)
+		return;
+
+	if (!this->ReserveProcessingBuffer(LOGGER_NT_MAXIMUM_MESSAGE_LENGTH + 2))
+		return;
+
+	for (ULONG Offset = 0; Offset < this->EarlyBufferLength; )
+	{
+		auto const* EarlyRecord = (CONST LoggerEarlyRecord*) &this->EarlyBuffer[Offset];
+		Offset += EarlyRecord->Size;
+
+		auto const* Format = (CONST WCHAR*) (EarlyRecord + 1);
+		LogFormatRender(Format, (CONST UCHAR*) (Format + EarlyRecord->FormatLength), EarlyRecord->ArgumentsLength, this->LogProcessingBuffer, LOGGER_NT_MAXIMUM_MESSAGE_LENGTH + 1);
+		this->ReplayEvent(InProvider, EarlyRecord->Level, L"%ws", this->LogProcessingBuffer);
+	}
+
+	if (this->NumberOfDroppedEarlyRecords != 0)
+		this->ReplayEvent(InProvider, ELogLevel::Warning, L"%lu early messages could not be stored and were dropped.", this->NumberOfDroppedEarlyRecords);
+}
+
+/// <summary>
+/// Delivers a message to a single event provider.
+/// </summary>
+/// <param name="InProvider">The event provider.</param>
+/// <param name="InLogLevel">The severity.</param>
+/// <param name="InFormat">The format of the message.</param>
+/// <param name="...">The arguments for the message format.</param>
+void Logger::ReplayEvent(ILogEventProvider* InProvider, ELogLevel InLogLevel, CONST WCHAR* InFormat, ...)
+{
+	va_list Arguments;
+	va_start(Arguments, InFormat);
+	InProvider->LogEvent(InLogLevel, InFormat, Arguments);
+	va_end(Arguments);
+}
+
+/// <summary>
+/// Logs a message of the specified log level.
+/// </summary>
+/// <param name="InLogLevel">The severity.</param>
+/// <param name="InFormat">The format of the message.</param>
+/// <param name="...">The arguments for the message format.</param>
+void Logger::Log(ELogLevel InLogLevel, CONST WCHAR* InFormat, ...)
+{
+	va_list Arguments;
+	va_start(Arguments, InFormat);
+	this->Logv(InLogLevel, InFormat, Arguments);
+}
+
+/// <summary>
+/// Logs a message with the 'Trace' severity level.
+/// </summary>
+/// <param name="InFormat">The format of the message.</param>
+/// <param name="...">The arguments for the message format.</param>
+void Logger::Trace(CONST WCHAR* InFormat, ...)
+{
+	va_list Arguments;
+	va_start(Arguments, InFormat);
+	this->Logv(ELogLevel::Trace, InFormat, Arguments);
+}
+
+/// <summary>
+/// Logs a message with the 'Debug' severity level.
+/// </summary>
+/// <param name="InFormat">The format of the message.</param>
+/// <param name="...">The arguments for the message format.</param>
+void Logger::Debug(CONST WCHAR* InFormat, ...)
+{
+	va_list Arguments;
+	va_start(Arguments, InFormat);
+	this->Logv(ELogLevel::Debug, InFormat, Arguments);
+}
+
+/// <summary>
+/// Logs a message with the 'Information' severity level.
+/// </summary>
+/// <param name="InFormat">The format of the message.</param>
+/// <param name="...">The arguments for the message format.</param>
+void Logger::Info(CONST WCHAR* InFormat, ...)
+{
+	va_list Arguments;
+	va_start(Arguments, InFormat);
+	this->Logv(ELogLevel::Information, InFormat, Arguments);
+}
+
+/// <summary>
+/// Logs a message with the 'Warning' severity level.
+/// </summary>
+/// <param name="InFormat">The format of the message.</param>
+/// <param name="...">The arguments for the message format.</param>
+void Logger::Warning(CONST WCHAR* InFormat, ...)
+{
+	va_list Arguments;
+	va_start(Arguments, InFormat);
+	this->Logv(ELogLevel::Warning, InFormat, Arguments);
+}
+
+/// <summary>
+/// Logs a message with the 'Error' severity level.
+/// </summary>
+/// <param name="InFormat">The format of the message.</param>
+/// <param name="...">The arguments for the message format.</param>
+void Logger::Error(CONST WCHAR* InFormat, ...)
+{
+	va_list Arguments;
+	va_start(Arguments, InFormat);
+	this->Logv(ELogLevel::Error, InFormat, Arguments);
+}
+
+/// <summary>
+/// Logs a message with the 'Fatal' severity level.
+/// </summary>
+/// <param name="InFormat">The format of the message.</param>
+/// <param name="...">The arguments for the message format.</param>
+void Logger::Fatal(CONST WCHAR* InFormat, ...)
+{
+	va_list Arguments;
+	va_start(Arguments, InFormat);
+	this->Logv(ELogLevel::Fatal, InFormat, Arguments);
+}
+
+/// <summary>
+/// Initializes the LoggerNT library.
+/// </summary>
+/// <param name="InConfig">The configuration.</param>
+NTSTATUS LogInitLibrary(CONST LoggerConfig& InConfig)
+{
+	return DefaultLogger.Init(InConfig);
+}
+
+/// <summary>
+/// Replaces the configuration of the default logger instance, without pausing the logging on other processors.
+/// Must be called at an IRQL lower or equal to DISPATCH_LEVEL.
+/// </summary>
+/// <param name="InConfig">The new configuration.</param>
+NTSTATUS LogReconfigure(CONST LoggerConfig& InConfig)
+{
+	return DefaultLogger.Reconfigure(InConfig);
+}
+
+/// <summary>
+/// Logs a message of the specified log level.
+/// </summary>
+/// <param name="InLogLevel">The severity.</param>
+/// <param name="InFormat">The format of the message.</param>
+/// <param name="InArguments">The arguments for the message format.</param>
+void Logv(ELogLevel InLogLevel, CONST WCHAR* InFormat, va_list InArguments)
+{
+	DefaultLogger.Logv(InLogLevel, InFormat, InArguments);
+}
+
+/// <summary>
+/// Logs a binary payload as a hexadecimal dump, streamed in chunks of bounded size.
+/// The chunks are not atomic with each other: other messages, including the lines of other dumps, may be logged between
+/// two chunks. Every line starts with its offset in the payload.
+/// </summary>
+/// <param name="InLogLevel">The severity.</param>
+/// <param name="InTitle">The title of the dump.</param>
+/// <param name="InData">The payload.</param>
+/// <param name="InSize">The size of the payload.</param>
+void LogHexDump(ELogLevel InLogLevel, CONST WCHAR* InTitle, CONST VOID* InData, SIZE_T InSize)
+{
+	DefaultLogger.HexDump(InLogLevel, InTitle, InData, InSize);
 }
 
 /// <summary>
@@ -114,7 +969,7 @@ void Log(ELogLevel InLogLevel, CONST WCHAR* InFormat, ...)
 {
 	va_list Arguments;
 	va_start(Arguments, InFormat);
-	Logv(InLogLevel, InFormat, Arguments);
+	DefaultLogger.Logv(InLogLevel, InFormat, Arguments);
 }
 
 /// <summary>
@@ -126,7 +981,7 @@ void LogTrace(CONST WCHAR* InFormat, ...)
 {
 	va_list Arguments;
 	va_start(Arguments, InFormat);
-	Logv(ELogLevel::Trace, InFormat, Arguments);
+	DefaultLogger.Logv(ELogLevel::Trace, InFormat, Arguments);
 }
 
 /// <summary>
@@ -138,7 +993,7 @@ void LogDebug(CONST WCHAR* InFormat, ...)
 {
 	va_list Arguments;
 	va_start(Arguments, InFormat);
-	Logv(ELogLevel::Debug, InFormat, Arguments);
+	DefaultLogger.Logv(ELogLevel::Debug, InFormat, Arguments);
 }
 
 /// <summary>
@@ -150,7 +1005,7 @@ void LogInfo(CONST WCHAR* InFormat, ...)
 {
 	va_list Arguments;
 	va_start(Arguments, InFormat);
-	Logv(ELogLevel::Information, InFormat, Arguments);
+	DefaultLogger.Logv(ELogLevel::Information, InFormat, Arguments);
 }
 
 /// <summary>
@@ -162,7 +1017,7 @@ void LogWarning(CONST WCHAR* InFormat, ...)
 {
 	va_list Arguments;
 	va_start(Arguments, InFormat);
-	Logv(ELogLevel::Warning, InFormat, Arguments);
+	DefaultLogger.Logv(ELogLevel::Warning, InFormat, Arguments);
 }
 
 /// <summary>
@@ -174,7 +1029,7 @@ void LogError(CONST WCHAR* InFormat, ...)
 {
 	va_list Arguments;
 	va_start(Arguments, InFormat);
-	Logv(ELogLevel::Error, InFormat, Arguments);
+	DefaultLogger.Logv(ELogLevel::Error, InFormat, Arguments);
 }
 
 /// <summary>
@@ -186,5 +1041,5 @@ void LogFatal(CONST WCHAR* InFormat, ...)
 {
 	va_list Arguments;
 	va_start(Arguments, InFormat);
-	Logv(ELogLevel::Fatal, InFormat, Arguments);
+	DefaultLogger.Logv(ELogLevel::Fatal, InFormat, Arguments);
 }
@@ -0,0 +1,256 @@
+// 
+// Stress test of the runtime reconfiguration of a logger.
+// 
+// One thread per processor logs messages in a loop, while the driver entry keeps replacing the configuration of the
+// logger, alternating between a verbose and a quiet configuration. A provider checks that the header of every record
+// it receives was rendered with the same configuration the message was filtered with, never a mix of both. Every
+// reconfiguration must also be served by the fixed slots of the logger, so the memory used by the configuration stays
+// bounded however many times it is replaced.
+// 
+// Usage:
+// 
+//     sc create LogConfigStress type= kernel binPath= C:\Path\To\LogConfigStress.sys
+//     sc start LogConfigStress
+// 
+// The driver fails to start with STATUS_UNSUCCESSFUL if the test failed; the results are printed to the debugger.
+// 
+
+#include "../../src/Headers/LoggerNT.h"
+
+#define LOG_CONFIG_STRESS_MAXIMUM_THREADS 64
+#define LOG_CONFIG_STRESS_NUMBER_OF_RECONFIGURATIONS 100000
+
+/// <summary>
+/// Checks that the records it receives were entirely processed with a single configuration.
+/// </summary>
+class LogConfigStressProvider : public ILogProvider
+{
+public:
+
+	/// <summary>
+	/// The number of records rendered with the verbose configuration.
+	/// </summary>
+	LONG64 NumberOfVerboseRecords = 0;
+
+	/// <summary>
+	/// The number of records rendered with the quiet configuration.
+	/// </summary>
+	LONG64 NumberOfQuietRecords = 0;
+
+	/// <summary>
+	/// The number of records processed with a mix of both configurations.
+	/// </summary>
+	LONG64 NumberOfInconsistentRecords = 0;
+
+public:
+
+	/// <summary>
+	/// Checks a record, made of its header and its message.
+	/// </summary>
+	/// <param name="InRecord">The record.</param>
+	void Log(CONST LogRecord& InRecord) override
+	{
+		// 
+		// The verbose configuration prefixes the header with both the time and the processor, the quiet one with neither.
+		// 
+
+		auto const HasTimestamp = InRecord.Header[0] == '[' && InRecord.Header[1] != 'C';
+		auto const HasProcessor = strstr(InRecord.Header, "[CPU ") != nullptr;
+
+		// 
+		// Debug messages are filtered out by the quiet configuration, they must have been rendered with the verbose one.
+		// 
+
+		if (HasTimestamp != HasProcessor || (InRecord.Level == ELogLevel::Debug && !HasProcessor))
+			this->NumberOfInconsistentRecords++;
+		else if (HasProcessor)
+			this->NumberOfVerboseRecords++;
+		else
+			this->NumberOfQuietRecords++;
+	}
+
+	/// <summary>
+	/// Destroys this log provider.
+	/// </summary>
+	void Exit() override
+	{
+		// ...
+	}
+};
+
+namespace LogConfigStress
+{
+	/// <summary>
+	/// The logger being reconfigured.
+	/// </summary>
+	Logger StressLogger = { };
+
+	/// <summary>
+	/// The provider checking the records of the logger.
+	/// </summary>
+	LogConfigStressProvider StressProvider = { };
+
+	/// <summary>
+	/// Whether the logging threads should stop.
+	/// </summary>
+	volatile LONG ShouldStop = FALSE;
+}
+
+using namespace LogConfigStress;
+
+/// <summary>
+/// The routine of the logging threads.
+/// </summary>
+/// <param name="InContext">Unused.</param>
+void LogConfigStressThread(PVOID InContext)
+{
+	UNREFERENCED_PARAMETER(InContext);
+
+	for (ULONG Iteration = 0; ReadAcquire(&ShouldStop) == FALSE; ++Iteration)
+	{
+		StressLogger.Debug(L"Debug message #%lu.", Iteration);
+		StressLogger.Info(L"Information message #%lu.", Iteration);
+	}
+
+	PsTerminateSystemThread(STATUS_SUCCESS);
+}
+
+/// <summary>
+/// Called when the driver is unloaded.
+/// </summary>
+/// <param name="InDriverObject">The driver object.</param>
+void DriverUnload(PDRIVER_OBJECT InDriverObject)
+{
+	UNREFERENCED_PARAMETER(InDriverObject);
+}
+
+/// <summary>
+/// The entry point of the driver, running the stress test.
+/// </summary>
+/// <param name="InDriverObject">The driver object.</param>
+/// <param name="InRegistryPath">The registry path of the driver.</param>
+EXTERN_C NTSTATUS DriverEntry(PDRIVER_OBJECT InDriverObject, PUNICODE_STRING InRegistryPath)
+{
+	UNREFERENCED_PARAMETER(InRegistryPath);
+	InDriverObject->DriverUnload = DriverUnload;
+
+	// 
+	// Prepare both configurations.
+	// 
+
+	LoggerConfig VerboseConfig;
+	VerboseConfig.MinimumLevel = ELogLevel::Trace;
+	VerboseConfig.ShouldPrefixTimestamp = TRUE;
+	VerboseConfig.ShouldPrefixProcessor = TRUE;
+
+	LoggerConfig QuietConfig;
+	QuietConfig.MinimumLevel = ELogLevel::Information;
+	QuietConfig.ShouldPrefixTimestamp = FALSE;
+	QuietConfig.ShouldPrefixProcessor = FALSE;
+
+	auto Status = StressLogger.Init(QuietConfig);
+
+	if (!NT_SUCCESS(Status))
+		return Status;
+
+	if (StressLogger.AddProvider(&StressProvider) == nullptr)
+	{
+		StressLogger.Exit();
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	// 
+	// Start one logging thread per processor.
+	// 
+
+	PETHREAD Threads[LOG_CONFIG_STRESS_MAXIMUM_THREADS] = { };
+	ULONG NumberOfThreads = 0;
+
+	auto const NumberOfProcessors = min(KeQueryActiveProcessorCountEx(ALL_PROCESSOR_GROUPS), (ULONG) LOG_CONFIG_STRESS_MAXIMUM_THREADS);
+
+	for (ULONG ThreadIdx = 0; ThreadIdx < NumberOfProcessors; ++ThreadIdx)
+	{
+		HANDLE ThreadHandle;
+
+		if (!NT_SUCCESS(PsCreateSystemThread(&ThreadHandle, THREAD_ALL_ACCESS, NULL, NULL, NULL, LogConfigStressThread, nullptr)))
+			break;
+
+		if (!NT_SUCCESS(ObReferenceObjectByHandle(ThreadHandle, SYNCHRONIZE, *PsThreadType, KernelMode, (PVOID*) &Threads[NumberOfThreads], NULL)))
+		{
+			// 
+			// Without a reference we cannot wait for it, stop everything right away.
+			// 
+
+			InterlockedExchange(&ShouldStop, TRUE);
+			ZwWaitForSingleObject(ThreadHandle, FALSE, NULL);
+			ZwClose(ThreadHandle);
+			break;
+		}
+
+		ZwClose(ThreadHandle);
+		NumberOfThreads++;
+	}
+
+	// 
+	// Replace the configuration in a loop, while the threads are logging.
+	// 
+
+	ULONG NumberOfFailedReconfigurations = 0;
+	ULONG NumberOfUnboundedSnapshots = 0;
+
+	auto const InitialVersion = StressLogger.ConfigSnapshots[StressLogger.ActiveConfigIndex].Version;
+
+	for (ULONG Iteration = 0; Iteration < LOG_CONFIG_STRESS_NUMBER_OF_RECONFIGURATIONS && ReadAcquire(&ShouldStop) == FALSE; ++Iteration)
+	{
+		auto const& NewConfig = (Iteration % 2) == 0 ? VerboseConfig : QuietConfig;
+
+		if (!NT_SUCCESS(StressLogger.Reconfigure(NewConfig)) || StressLogger.GetConfig().MinimumLevel != NewConfig.MinimumLevel)
+			NumberOfFailedReconfigurations++;
+
+		// 
+		// The new version must have been published in one of the slots of the logger, rather than in a new allocation.
+		// 
+
+		auto const ActiveIndex = (ULONG) ReadAcquire(&StressLogger.ActiveConfigIndex);
+
+		if (ActiveIndex >= ARRAYSIZE(StressLogger.ConfigSnapshots) || StressLogger.ConfigSnapshots[ActiveIndex].Version != InitialVersion + Iteration + 1)
+			NumberOfUnboundedSnapshots++;
+	}
+
+	// 
+	// Stop the threads, and destroy the logger.
+	// 
+
+	InterlockedExchange(&ShouldStop, TRUE);
+
+	for (ULONG ThreadIdx = 0; ThreadIdx < NumberOfThreads; ++ThreadIdx)
+	{
+		KeWaitForSingleObject(Threads[ThreadIdx], Executive, KernelMode, FALSE, NULL);
+		ObDereferenceObject(Threads[ThreadIdx]);
+	}
+
+	StressLogger.Exit();
+
+	// 
+	// Report the results.
+	// 
+
+	auto const HasFailed = NumberOfThreads != NumberOfProcessors ||
+		NumberOfFailedReconfigurations != 0 ||
+		NumberOfUnboundedSnapshots != 0 ||
+		StressProvider.NumberOfInconsistentRecords != 0 ||
+		StressProvider.NumberOfVerboseRecords == 0 ||
+		StressProvider.NumberOfQuietRecords == 0;
+
+	DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "[LogConfigStress] %s: %lu threads, %lu failed reconfigurations, %lu outside of the %lu slots, %lld verbose, %lld quiet and %lld inconsistent records.\n",
+		HasFailed ? "FAILED" : "PASSED",
+		NumberOfThreads,
+		NumberOfFailedReconfigurations,
+		NumberOfUnboundedSnapshots,
+		(ULONG) ARRAYSIZE(StressLogger.ConfigSnapshots),
+		StressProvider.NumberOfVerboseRecords,
+		StressProvider.NumberOfQuietRecords,
+		StressProvider.NumberOfInconsistentRecords);
+
+	return HasFailed ? STATUS_UNSUCCESSFUL : STATUS_SUCCESS;
+}
@@ -0,0 +1,526 @@
+// 
+// Test of the shared log ring protocol, between two processes.
+// 
+// The test maps a small ring in a named file mapping, then starts two copies of itself: a producer, which appends
+// records with the producer of LogRingLayout.h the driver also uses, and a consumer, which reads them with the reference
+// consumer of LogRingLayout.h. The test runs in three phases:
+// 
+//  - The producer writes batches of records, waiting for the consumer to read each batch. The ring wraps around many
+//    times, and no record may be lost.
+//  - The producer writes many times the size of the ring at once. The consumer is lapped, and must count exactly the
+//    overwritten records as lost.
+//  - The producer writes without waiting, while the consumer reads. Every record is either read or counted as lost,
+//    and records overwritten while they were being read are discarded.
+// 
+// Every record read is rendered and compared to the message expected for its sequence number.
+// 
+// Usage: LogRingTest
+// 
+// The test exits with 0 if it succeeded, the results are printed to the standard output.
+// 
+
+#define NOMINMAX
+#include <windows.h>
+
+#include <cstdarg>
+#include <cstdio>
+#include <cwchar>
+
+#include "../../src/Headers/LogRingLayout.h"
+
+#define LOG_RING_TEST_DATA_SIZE (64 * 1024)
+#define LOG_RING_TEST_STRING_TABLE_SIZE (4 * 1024)
+#define LOG_RING_TEST_SECTION_SIZE (4096 + LOG_RING_TEST_DATA_SIZE + LOG_RING_TEST_STRING_TABLE_SIZE)
+
+#define LOG_RING_TEST_NUMBER_OF_BATCHES 200
+#define LOG_RING_TEST_RECORDS_PER_BATCH 100
+#define LOG_RING_TEST_OVERRUN_RECORDS 20000
+#define LOG_RING_TEST_CONCURRENT_RECORDS 1000000
+
+#define LOG_RING_TEST_EVENT_FORMAT L"Event #%lld: %ls"
+#define LOG_RING_TEST_TEXT_FORMAT L"Text record #%lld."
+#define LOG_RING_TEST_MAXIMUM_MESSAGE_LENGTH 256
+
+/// <summary>
+/// The named objects shared by the processes of the test.
+/// </summary>
+struct LogRingTestNames
+{
+	/// <summary>
+	/// The name of the file mapping holding the ring.
+	/// </summary>
+	WCHAR Section[64];
+
+	/// <summary>
+	/// The name of the event signaled by the producer once it wrote a batch of records.
+	/// </summary>
+	WCHAR Written[64];
+
+	/// <summary>
+	/// The name of the event signaled by the consumer once it read a batch of records.
+	/// </summary>
+	WCHAR Consumed[64];
+
+	/// <summary>
+	/// Builds the names of the objects of a test, from its identifier.
+	/// </summary>
+	/// <param name="InTestId">The identifier of the test.</param>
+	void Build(CONST WCHAR* InTestId)
+	{
+		_snwprintf_s(this->Section, _TRUNCATE, L"Local\\LogRingTest-%ls", InTestId);
+		_snwprintf_s(this->Written, _TRUNCATE, L"Local\\LogRingTest-%ls-Written", InTestId);
+		_snwprintf_s(this->Consumed, _TRUNCATE, L"Local\\LogRingTest-%ls-Consumed", InTestId);
+	}
+};
+
+/// <summary>
+/// Builds the string argument of the event of a sequence number, whose length varies with the sequence number so
+/// records of every size wrap around the ring.
+/// </summary>
+/// <param name="InSequence">The sequence number.</param>
+/// <param name="OutFiller">The buffer receiving the string, of 64 characters.</param>
+static void BuildFiller(LONG64 InSequence, WCHAR* OutFiller)
+{
+	auto const FillerLength = (SIZE_T) (InSequence % 41);
+	wmemset(OutFiller, L'x', FillerLength);
+	OutFiller[FillerLength] = L'\0';
+}
+
+/// <summary>
+/// Builds the message expected for a sequence number, and returns whether it is stored as an event or as a text.
+/// </summary>
+/// <param name="InSequence">The sequence number.</param>
+/// <param name="OutMessage">The buffer receiving the message, of LOG_RING_TEST_MAXIMUM_MESSAGE_LENGTH characters.</param>
+static BOOLEAN BuildExpectedMessage(LONG64 InSequence, WCHAR* OutMessage)
+{
+	if (InSequence % 3 == 0)
+	{
+		_snwprintf_s(OutMessage, LOG_RING_TEST_MAXIMUM_MESSAGE_LENGTH, _TRUNCATE, LOG_RING_TEST_TEXT_FORMAT, InSequence);
+		return FALSE;
+	}
+
+	WCHAR Filler[64];
+	BuildFiller(InSequence, Filler);
+
+	_snwprintf_s(OutMessage, LOG_RING_TEST_MAXIMUM_MESSAGE_LENGTH, _TRUNCATE, LOG_RING_TEST_EVENT_FORMAT, InSequence, Filler);
+	return TRUE;
+}
+
+/// <summary>
+/// Appends records to the ring, with the producer of LogRingLayout.h the driver uses.
+/// </summary>
+struct LogRingTestProducer
+{
+	/// <summary>
+	/// The producer of the ring.
+	/// </summary>
+	LOG_RING_PRODUCER Producer = { };
+
+	/// <summary>
+	/// The identifier of the format of the event records.
+	/// </summary>
+	ULONG EventStringId = LOG_RING_INVALID_STRING;
+
+	/// <summary>
+	/// Attaches the producer to a ring, and interns the format of the event records.
+	/// </summary>
+	/// <param name="InSection">The base address of the mapped section.</param>
+	BOOLEAN Init(VOID* InSection)
+	{
+		LogRingProducerInit(&this->Producer, InSection);
+		this->EventStringId = LogRingProducerAddString(&this->Producer, LOG_RING_TEST_EVENT_FORMAT, ARRAYSIZE(LOG_RING_TEST_EVENT_FORMAT) - 1, 0, 0);
+		return this->EventStringId != LOG_RING_INVALID_STRING;
+	}
+
+	/// <summary>
+	/// Appends the record of the next sequence number, as an event or as a text.
+	/// </summary>
+	void WriteNext()
+	{
+		auto const Sequence = this->Producer.Header->NextSequence;
+
+		WCHAR Message[LOG_RING_TEST_MAXIMUM_MESSAGE_LENGTH];
+
+		if (!BuildExpectedMessage(Sequence, Message))
+		{
+			LogRingProducerAppend(&this->Producer, LOG_RING_RECORD_TEXT, 0, Sequence, 0, 0, nullptr, 0, Message, wcslen(Message) * sizeof(WCHAR));
+			return;
+		}
+
+		WCHAR Filler[64];
+		BuildFiller(Sequence, Filler);
+
+		UCHAR Arguments[512];
+		LOG_RING_EVENT Event = { };
+		Event.StringId = this->EventStringId;
+
+		this->Encode(Arguments, sizeof(Arguments), &Event.Length, Sequence, Filler);
+		LogRingProducerAppend(&this->Producer, LOG_RING_RECORD_EVENT, 0, Sequence, 0, 0, &Event, sizeof(Event), Arguments, Event.Length);
+	}
+
+	/// <summary>
+	/// Encodes the arguments of the format of the event records.
+	/// </summary>
+	/// <param name="OutBuffer">The buffer receiving the encoded arguments.</param>
+	/// <param name="InCapacity">The size of the output buffer, in bytes.</param>
+	/// <param name="OutLength">The size of the encoded arguments, in bytes.</param>
+	void Encode(UCHAR* OutBuffer, ULONG InCapacity, ULONG* OutLength, ...)
+	{
+		va_list Arguments;
+		va_start(Arguments, OutLength);
+		LogFormatEncode(LOG_RING_TEST_EVENT_FORMAT, Arguments, OutBuffer, InCapacity, OutLength);
+		va_end(Arguments);
+	}
+};
+
+/// <summary>
+/// Reads the records of the ring, and checks them.
+/// </summary>
+struct LogRingTestConsumer
+{
+	/// <summary>
+	/// The reference consumer.
+	/// </summary>
+	LOG_RING_CONSUMER Consumer = { };
+
+	/// <summary>
+	/// The number of records read and validated.
+	/// </summary>
+	LONG64 NumberOfRecords = 0;
+
+	/// <summary>
+	/// The number of records discarded because they were overwritten while being read.
+	/// </summary>
+	LONG64 NumberOfDiscardedRecords = 0;
+
+	/// <summary>
+	/// The number of records whose message was not the expected one.
+	/// </summary>
+	LONG64 NumberOfCorruptedRecords = 0;
+
+	/// <summary>
+	/// The sequence number of the last record read, or -1.
+	/// </summary>
+	LONG64 LastSequence = -1;
+
+	/// <summary>
+	/// Reads every record committed so far.
+	/// </summary>
+	void ReadAll()
+	{
+		while (auto const* Record = LogRingConsumerPeek(&this->Consumer))
+		{
+			auto const Type = Record->Type;
+			auto const Sequence = Record->Sequence;
+
+			WCHAR Message[LOG_RING_TEST_MAXIMUM_MESSAGE_LENGTH];
+			LogRingConsumerRender(&this->Consumer, Record, Message, ARRAYSIZE(Message));
+
+			if (!LogRingConsumerRelease(&this->Consumer, Record))
+			{
+				this->NumberOfDiscardedRecords++;
+				continue;
+			}
+
+			// 
+			// The message can be trusted, now that the record is known not to have been overwritten.
+			// 
+
+			if (Type == LOG_RING_RECORD_DEFINITION)
+				continue;
+
+			WCHAR ExpectedMessage[LOG_RING_TEST_MAXIMUM_MESSAGE_LENGTH];
+			auto const IsEvent = BuildExpectedMessage(Sequence, ExpectedMessage);
+
+			if (Sequence <= this->LastSequence || IsEvent != (Type == LOG_RING_RECORD_EVENT) || wcscmp(Message, ExpectedMessage) != 0)
+			{
+				if (this->NumberOfCorruptedRecords++ == 0)
+					wprintf(L"Record #%lld: expected '%ls', read '%ls'.\n", Sequence, ExpectedMessage, Message);
+			}
+
+			this->LastSequence = Sequence;
+			this->NumberOfRecords++;
+		}
+	}
+
+	/// <summary>
+	/// Checks that every record written so far was either read or counted as lost, and reports the results.
+	/// </summary>
+	/// <param name="InPhase">The name of the phase, for the report.</param>
+	/// <param name="InNumberOfWrittenRecords">The number of records written so far.</param>
+	/// <param name="InMinimumLostRecords">The minimum number of records that must have been lost so far.</param>
+	/// <param name="InMaximumLostRecords">The maximum number of records that may have been lost so far.</param>
+	BOOLEAN Check(CONST CHAR* InPhase, LONG64 InNumberOfWrittenRecords, LONG64 InMinimumLostRecords, LONG64 InMaximumLostRecords)
+	{
+		auto const LostRecords = this->Consumer.LostRecords;
+		auto const HasSucceeded = this->NumberOfCorruptedRecords == 0 &&
+			this->NumberOfRecords + LostRecords == InNumberOfWrittenRecords &&
+			this->LastSequence == InNumberOfWrittenRecords - 1 &&
+			LostRecords >= InMinimumLostRecords &&
+			LostRecords <= InMaximumLostRecords;
+
+		printf("[%s] %s: %lld written, %lld read, %lld lost, %lld discarded, %lld corrupted.\n",
+			InPhase,
+			HasSucceeded ? "PASSED" : "FAILED",
+			InNumberOfWrittenRecords,
+			this->NumberOfRecords,
+			LostRecords,
+			this->NumberOfDiscardedRecords,
+			this->NumberOfCorruptedRecords);
+
+		return HasSucceeded;
+	}
+};
+
+/// <summary>
+/// The routine of the producer process.
+/// </summary>
+/// <param name="InNames">The names of the shared objects.</param>
+static int RunProducer(CONST LogRingTestNames& InNames)
+{
+	auto const Section = OpenFileMappingW(FILE_MAP_READ | FILE_MAP_WRITE, FALSE, InNames.Section);
+	auto const Written = OpenEventW(EVENT_MODIFY_STATE, FALSE, InNames.Written);
+	auto const Consumed = OpenEventW(SYNCHRONIZE, FALSE, InNames.Consumed);
+
+	if (Section == nullptr || Written == nullptr || Consumed == nullptr)
+		return 2;
+
+	auto* View = MapViewOfFile(Section, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, 0);
+
+	if (View == nullptr)
+		return 2;
+
+	LogRingTestProducer Producer;
+
+	if (!Producer.Init(View))
+		return 2;
+
+	// 
+	// Write batches the consumer keeps up with, while the ring wraps around.
+	// 
+
+	for (ULONG BatchIdx = 0; BatchIdx < LOG_RING_TEST_NUMBER_OF_BATCHES; ++BatchIdx)
+	{
+		for (ULONG RecordIdx = 0; RecordIdx < LOG_RING_TEST_RECORDS_PER_BATCH; ++RecordIdx)
+			Producer.WriteNext();
+
+		SignalObjectAndWait(Written, Consumed, INFINITE, FALSE);
+	}
+
+	// 
+	// Write more than the ring can hold, then a batch from which the consumer learns how many records it lost.
+	// 
+
+	for (ULONG RecordIdx = 0; RecordIdx < LOG_RING_TEST_OVERRUN_RECORDS; ++RecordIdx)
+		Producer.WriteNext();
+
+	SignalObjectAndWait(Written, Consumed, INFINITE, FALSE);
+
+	for (ULONG RecordIdx = 0; RecordIdx < LOG_RING_TEST_RECORDS_PER_BATCH; ++RecordIdx)
+		Producer.WriteNext();
+
+	SignalObjectAndWait(Written, Consumed, INFINITE, FALSE);
+
+	// 
+	// Write without waiting for the consumer, then a last batch once it caught up.
+	// 
+
+	for (ULONG RecordIdx = 0; RecordIdx < LOG_RING_TEST_CONCURRENT_RECORDS; ++RecordIdx)
+		Producer.WriteNext();
+
+	SignalObjectAndWait(Written, Consumed, INFINITE, FALSE);
+
+	for (ULONG RecordIdx = 0; RecordIdx < LOG_RING_TEST_RECORDS_PER_BATCH; ++RecordIdx)
+		Producer.WriteNext();
+
+	SetEvent(Written);
+	return 0;
+}
+
+/// <summary>
+/// The routine of the consumer process.
+/// </summary>
+/// <param name="InNames">The names of the shared objects.</param>
+static int RunConsumer(CONST LogRingTestNames& InNames)
+{
+	auto const Section = OpenFileMappingW(FILE_MAP_READ, FALSE, InNames.Section);
+	auto const Written = OpenEventW(SYNCHRONIZE, FALSE, InNames.Written);
+	auto const Consumed = OpenEventW(EVENT_MODIFY_STATE, FALSE, InNames.Consumed);
+
+	if (Section == nullptr || Written == nullptr || Consumed == nullptr)
+		return 2;
+
+	auto const* View = MapViewOfFile(Section, FILE_MAP_READ, 0, 0, 0);
+
+	if (View == nullptr)
+		return 2;
+
+	LogRingTestConsumer Consumer;
+
+	if (!LogRingConsumerInit(&Consumer.Consumer, View))
+		return 2;
+
+	BOOLEAN HasSucceeded = TRUE;
+	LONG64 NumberOfWrittenRecords = 0;
+
+	// 
+	// Every batch must be read entirely, while the ring wraps around.
+	// 
+
+	for (ULONG BatchIdx = 0; BatchIdx < LOG_RING_TEST_NUMBER_OF_BATCHES; ++BatchIdx)
+	{
+		WaitForSingleObject(Written, INFINITE);
+		Consumer.ReadAll();
+		SetEvent(Consumed);
+	}
+
+	NumberOfWrittenRecords += (LONG64) LOG_RING_TEST_NUMBER_OF_BATCHES * LOG_RING_TEST_RECORDS_PER_BATCH;
+	HasSucceeded &= Consumer.Check("Wrap-around", NumberOfWrittenRecords, 0, 0);
+
+	// 
+	// The consumer was lapped, it resynchronizes on the last record and cannot read any of the overwritten records.
+	// They must be counted as lost as soon as the next record is read, and not one more.
+	// 
+
+	WaitForSingleObject(Written, INFINITE);
+	Consumer.ReadAll();
+	SetEvent(Consumed);
+
+	WaitForSingleObject(Written, INFINITE);
+	Consumer.ReadAll();
+	SetEvent(Consumed);
+
+	NumberOfWrittenRecords += LOG_RING_TEST_OVERRUN_RECORDS + LOG_RING_TEST_RECORDS_PER_BATCH;
+	HasSucceeded &= Consumer.Check("Overrun", NumberOfWrittenRecords, LOG_RING_TEST_OVERRUN_RECORDS, LOG_RING_TEST_OVERRUN_RECORDS);
+
+	// 
+	// Read while the producer writes, until it is done, then read the last batch which accounts for any lost tail.
+	// 
+
+	while (WaitForSingleObject(Written, 0) != WAIT_OBJECT_0)
+		Consumer.ReadAll();
+
+	Consumer.ReadAll();
+	SetEvent(Consumed);
+
+	WaitForSingleObject(Written, INFINITE);
+	Consumer.ReadAll();
+
+	NumberOfWrittenRecords += LOG_RING_TEST_CONCURRENT_RECORDS + LOG_RING_TEST_RECORDS_PER_BATCH;
+	HasSucceeded &= Consumer.Check("Concurrent", NumberOfWrittenRecords, LOG_RING_TEST_OVERRUN_RECORDS, LOG_RING_TEST_OVERRUN_RECORDS + LOG_RING_TEST_CONCURRENT_RECORDS);
+	HasSucceeded &= ReadAcquire64(&((CONST LOG_RING_HEADER*) View)->NextSequence) == NumberOfWrittenRecords;
+
+	return HasSucceeded ? 0 : 1;
+}
+
+/// <summary>
+/// Starts a process of the test.
+/// </summary>
+/// <param name="InRole">The role of the process.</param>
+/// <param name="InTestId">The identifier of the test.</param>
+/// <param name="OutProcessInfo">The handles to the process.</param>
+static BOOLEAN StartProcess(CONST WCHAR* InRole, CONST WCHAR* InTestId, PROCESS_INFORMATION* OutProcessInfo)
+{
+	WCHAR ImagePath[MAX_PATH];
+
+	if (GetModuleFileNameW(nullptr, ImagePath, ARRAYSIZE(ImagePath)) == ARRAYSIZE(ImagePath))
+		return FALSE;
+
+	WCHAR CommandLine[MAX_PATH + 64];
+	_snwprintf_s(CommandLine, _TRUNCATE, L"\"%ls\" %ls %ls", ImagePath, InRole, InTestId);
+
+	STARTUPINFOW StartupInfo = { };
+	StartupInfo.cb = sizeof(StartupInfo);
+
+	return CreateProcessW(ImagePath, CommandLine, nullptr, nullptr, FALSE, 0, nullptr, nullptr, &StartupInfo, OutProcessInfo);
+}
+
+/// <summary>
+/// The entry point of the test.
+/// </summary>
+int wmain(int InArgc, WCHAR** InArgv)
+{
+	// 
+	// The processes started by the test find the shared objects from the identifier of the test.
+	// 
+
+	LogRingTestNames Names;
+
+	if (InArgc == 3)
+	{
+		Names.Build(InArgv[2]);
+
+		if (wcscmp(InArgv[1], L"producer") == 0)
+			return RunProducer(Names);
+
+		if (wcscmp(InArgv[1], L"consumer") == 0)
+			return RunConsumer(Names);
+
+		return 2;
+	}
+
+	WCHAR TestId[16];
+	_snwprintf_s(TestId, _TRUNCATE, L"%lu", GetCurrentProcessId());
+	Names.Build(TestId);
+
+	// 
+	// Create the ring, laid out as the driver does, and the events synchronizing the phases.
+	// 
+
+	auto const Section = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, LOG_RING_TEST_SECTION_SIZE, Names.Section);
+	auto const Written = CreateEventW(nullptr, FALSE, FALSE, Names.Written);
+	auto const Consumed = CreateEventW(nullptr, FALSE, FALSE, Names.Consumed);
+
+	if (Section == nullptr || Written == nullptr || Consumed == nullptr)
+	{
+		printf("Failed to create the shared objects (%lu).\n", GetLastError());
+		return 2;
+	}
+
+	auto* Header = (LOG_RING_HEADER*) MapViewOfFile(Section, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, 0);
+
+	if (Header == nullptr)
+	{
+		printf("Failed to map the ring (%lu).\n", GetLastError());
+		return 2;
+	}
+
+	Header->Magic = LOG_RING_MAGIC;
+	Header->Version = LOG_RING_VERSION;
+	Header->HeaderSize = 4096;
+	Header->DataSize = LOG_RING_TEST_DATA_SIZE;
+	Header->StringTableOffset = 4096 + LOG_RING_TEST_DATA_SIZE;
+	Header->StringTableSize = LOG_RING_TEST_STRING_TABLE_SIZE;
+
+	// 
+	// Start the consumer first, so it attaches to the ring before anything is written, then the producer.
+	// 
+
+	PROCESS_INFORMATION Consumer = { };
+	PROCESS_INFORMATION Producer = { };
+
+	if (!StartProcess(L"consumer", TestId, &Consumer))
+	{
+		printf("Failed to start the consumer (%lu).\n", GetLastError());
+		return 2;
+	}
+
+	if (!StartProcess(L"producer", TestId, &Producer))
+	{
+		printf("Failed to start the producer (%lu).\n", GetLastError());
+		TerminateProcess(Consumer.hProcess, 2);
+		return 2;
+	}
+
+	HANDLE Processes[] = { Consumer.hProcess, Producer.hProcess };
+	WaitForMultipleObjects(ARRAYSIZE(Processes), Processes, TRUE, INFINITE);
+
+	DWORD ConsumerExitCode = 2;
+	DWORD ProducerExitCode = 2;
+	GetExitCodeProcess(Consumer.hProcess, &ConsumerExitCode);
+	GetExitCodeProcess(Producer.hProcess, &ProducerExitCode);
+
+	auto const HasSucceeded = ConsumerExitCode == 0 && ProducerExitCode == 0;
+	printf("%s: producer exited with %lu, consumer exited with %lu.\n", HasSucceeded ? "PASSED" : "FAILED", ProducerExitCode, ConsumerExitCode);
+	return HasSucceeded ? 0 : 1;
+}
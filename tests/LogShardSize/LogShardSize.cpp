@@ -0,0 +1,162 @@
+// 
+// Measures the size of the shard files, when messages are stored as text and when they are stored as events.
+// 
+// The driver entry logs a repetitive workload, a few format strings with varying arguments, to a logger with two
+// sharded file providers: one storing text records, the other storing definition and event records. The workload is
+// logged in batches the buffers of the providers can hold, so neither of them drops any message, and both write the
+// exact same messages.
+// 
+// Usage:
+// 
+//     sc create LogShardSize type= kernel binPath= C:\Path\To\LogShardSize.sys
+//     sc start LogShardSize
+// 
+// The driver fails to start with STATUS_UNSUCCESSFUL if the events did not take less space than the text, or if any
+// message was dropped; the sizes are printed to the debugger. Both sets of shards are left in the temporary system folder, and can be compared with
+// the LogShardMerge tool.
+// 
+
+#include "../../src/Headers/LoggerNT.h"
+
+#define LOG_SHARD_SIZE_NUMBER_OF_BATCHES 50
+#define LOG_SHARD_SIZE_MESSAGES_PER_BATCH 1000
+#define LOG_SHARD_SIZE_BUFFER_SIZE (1024 * 1024)
+
+namespace LogShardSize
+{
+	/// <summary>
+	/// The logger delivering the workload to both providers.
+	/// </summary>
+	Logger SizeLogger = { };
+
+	/// <summary>
+	/// The provider storing the messages as text records.
+	/// </summary>
+	ShardedFileProvider TextProvider = { };
+
+	/// <summary>
+	/// The provider storing the messages as event records.
+	/// </summary>
+	ShardedFileProvider EventProvider = { };
+}
+
+using namespace LogShardSize;
+
+/// <summary>
+/// Logs a message of the workload, picked from its index.
+/// </summary>
+/// <param name="InMessageIdx">The index of the message.</param>
+void LogShardSizeMessage(ULONG InMessageIdx)
+{
+	static CONST WCHAR* CONST MajorFunctions[] = { L"CREATE", L"CLOSE", L"READ", L"WRITE", L"DEVICE_CONTROL", L"CLEANUP" };
+
+	auto const FakeAddress = (PVOID) (ULONG_PTR) (0xFFFF800012340000ull + InMessageIdx * 0x40ull);
+
+	switch (InMessageIdx % 6)
+	{
+		case 0:
+			SizeLogger.Info(L"IRP_MJ_%ws completed for device %p with status 0x%08X.", MajorFunctions[InMessageIdx % ARRAYSIZE(MajorFunctions)], FakeAddress, InMessageIdx % 7 == 0 ? STATUS_ACCESS_DENIED : STATUS_SUCCESS);
+			break;
+
+		case 1:
+			SizeLogger.Info(L"Process %lu created thread %lu, starting at %p.", 4 + InMessageIdx % 97 * 4, 1000 + InMessageIdx * 4, FakeAddress);
+			break;
+
+		case 2:
+			SizeLogger.Info(L"Read %lu bytes at offset %lld from '%ws'.", 512 * (1 + InMessageIdx % 16), (LONG64) InMessageIdx * 4096, L"\\Device\\HarddiskVolume3\\Windows\\System32\\config\\SOFTWARE");
+			break;
+
+		case 3:
+			SizeLogger.Info(L"Packet of %lu bytes received from %hhu.%hhu.%hhu.%hhu:%hu.", 64 + InMessageIdx % 1400, (UCHAR) 192, (UCHAR) 168, (UCHAR) (InMessageIdx >> 8), (UCHAR) InMessageIdx, (USHORT) (49152 + InMessageIdx % 16384));
+			break;
+
+		case 4:
+			SizeLogger.Info(L"Queue depth is %lu, %lu requests pending and %lu completed.", InMessageIdx % 32, InMessageIdx % 5, InMessageIdx);
+			break;
+
+		default:
+			SizeLogger.Info(L"Callback %hs invoked in %lld ticks.", InMessageIdx % 2 == 0 ? "ProcessNotify" : "ImageLoadNotify", (LONG64) (InMessageIdx % 1000) * 3);
+			break;
+	}
+}
+
+/// <summary>
+/// Called when the driver is unloaded.
+/// </summary>
+/// <param name="InDriverObject">The driver object.</param>
+void DriverUnload(PDRIVER_OBJECT InDriverObject)
+{
+	UNREFERENCED_PARAMETER(InDriverObject);
+}
+
+/// <summary>
+/// The entry point of the driver, running the measurement.
+/// </summary>
+/// <param name="InDriverObject">The driver object.</param>
+/// <param name="InRegistryPath">The registry path of the driver.</param>
+EXTERN_C NTSTATUS DriverEntry(PDRIVER_OBJECT InDriverObject, PUNICODE_STRING InRegistryPath)
+{
+	UNREFERENCED_PARAMETER(InRegistryPath);
+	InDriverObject->DriverUnload = DriverUnload;
+
+	// 
+	// Deliver every message to both providers.
+	// 
+
+	LoggerConfig Config;
+	Config.MinimumLevel = ELogLevel::Information;
+
+	auto Status = SizeLogger.Init(Config);
+
+	if (!NT_SUCCESS(Status))
+		return Status;
+
+	Status = TextProvider.UseFilesNamed(L"LogShardSize.Text", LOG_SHARD_SIZE_BUFFER_SIZE, FALSE);
+
+	if (NT_SUCCESS(Status))
+		Status = EventProvider.UseFilesNamed(L"LogShardSize.Events", LOG_SHARD_SIZE_BUFFER_SIZE, TRUE);
+
+	if (!NT_SUCCESS(Status) || SizeLogger.AddProvider(&TextProvider) == nullptr || SizeLogger.AddProvider(&EventProvider) == nullptr)
+	{
+		SizeLogger.Exit();
+		TextProvider.Exit();
+		EventProvider.Exit();
+		return NT_SUCCESS(Status) ? STATUS_INSUFFICIENT_RESOURCES : Status;
+	}
+
+	// 
+	// Log the workload, leaving the worker threads twice their interval to drain every batch.
+	// 
+
+	LARGE_INTEGER DrainDelay;
+	DrainDelay.QuadPart = -10000LL * SHARDED_FILE_PROVIDER_DRAIN_INTERVAL * 2;
+
+	for (ULONG BatchIdx = 0; BatchIdx < LOG_SHARD_SIZE_NUMBER_OF_BATCHES; ++BatchIdx)
+	{
+		for (ULONG MessageIdx = 0; MessageIdx < LOG_SHARD_SIZE_MESSAGES_PER_BATCH; ++MessageIdx)
+			LogShardSizeMessage(BatchIdx * LOG_SHARD_SIZE_MESSAGES_PER_BATCH + MessageIdx);
+
+		KeDelayExecutionThread(KernelMode, FALSE, &DrainDelay);
+	}
+
+	// 
+	// The providers write what is left in their buffers when the logger exits.
+	// 
+
+	SizeLogger.Exit();
+
+	auto const TextSize = TextProvider.GetNumberOfBytesWritten();
+	auto const EventSize = EventProvider.GetNumberOfBytesWritten();
+	auto const NumberOfDroppedMessages = TextProvider.GetNumberOfDroppedMessages() + EventProvider.GetNumberOfDroppedMessages();
+	auto const HasFailed = TextSize == 0 || EventSize == 0 || EventSize >= TextSize || NumberOfDroppedMessages != 0;
+
+	DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "[LogShardSize] %s: %lu messages, %llu dropped, %llu bytes as text, %llu bytes as events (%llu%% of the text).\n",
+		HasFailed ? "FAILED" : "PASSED",
+		(ULONG) (LOG_SHARD_SIZE_NUMBER_OF_BATCHES * LOG_SHARD_SIZE_MESSAGES_PER_BATCH),
+		NumberOfDroppedMessages,
+		TextSize,
+		EventSize,
+		TextSize == 0 ? 0ull : EventSize * 100 / TextSize);
+
+	return HasFailed ? STATUS_UNSUCCESSFUL : STATUS_SUCCESS;
+}
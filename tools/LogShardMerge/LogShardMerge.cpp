@@ -0,0 +1,650 @@
+// 
+// Merges the shard files written by the ShardedFileProvider into a single stream, ordered by timestamp.
+// 
+// Usage: LogShardMerge <shard> [<shard> ...] > merged.log
+// 
+// The shards are read one record at a time and merged with a k-way merge, so the memory used only depends on the
+// number of shards, never on their size. The merged stream is written to the standard output in UTF-8, the timestamps
+// in UTC; the tails of the shards which were truncated by a crash are reported to the standard error, and skipped.
+// 
+// Event records are rendered from the format strings defined earlier in their shard, with the renderer of LogFormat.h
+// the driver also uses. Outside of Windows, the single conversions it formats are handled by a replacement of the
+// _snwprintf of the Windows runtime, which writes UTF-16 characters and prints the pointers the same way.
+// 
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+
+#define fseeko _fseeki64
+#define ftello _ftelli64
+#else
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+
+typedef uint8_t UCHAR;
+typedef char CHAR;
+typedef uint16_t USHORT;
+typedef uint16_t WCHAR;
+typedef int32_t LONG;
+typedef int32_t INT32;
+typedef uint32_t ULONG;
+typedef int64_t LONG64;
+typedef uint64_t ULONG64;
+typedef uintptr_t ULONG_PTR;
+typedef size_t SIZE_T;
+typedef UCHAR BOOLEAN;
+typedef void* PVOID;
+
+#define CONST const
+#define VOID void
+#define TRUE 1
+#define FALSE 0
+#define MAXULONG 0xFFFFFFFFu
+#define MAXSIZE_T ((SIZE_T) ~((SIZE_T) 0))
+#define ARRAYSIZE(Array) (sizeof(Array) / sizeof((Array)[0]))
+#define RtlCopyMemory memcpy
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <queue>
+#include <vector>
+
+#ifndef _WIN32
+
+/// <summary>
+/// Formats a single conversion into UTF-16 characters, as the _snwprintf of the Windows runtime does.
+/// Only supports the specifications built by LogFormatRender, which consume a single argument of a well-known size:
+/// strings are always bounded by a precision, integers are either 32-bits or 'll', and pointers are 64-bits.
+/// </summary>
+/// <param name="OutBuffer">The buffer receiving the characters, which are not null-terminated.</param>
+/// <param name="InCount">The size of the output buffer, in characters.</param>
+/// <param name="InSpec">The specification of the conversion.</param>
+/// <returns>The number of characters written, or -1 if they did not all fit in the output buffer.</returns>
+static int _snwprintf(WCHAR* OutBuffer, SIZE_T InCount, CONST WCHAR* InSpec, ...)
+{
+	CHAR Spec[64];
+	SIZE_T SpecLength = 0;
+
+	for (; InSpec[SpecLength] != 0 && SpecLength < sizeof(Spec) - 8; ++SpecLength)
+		Spec[SpecLength] = (CHAR) InSpec[SpecLength];
+
+	Spec[SpecLength] = '\0';
+
+	if (SpecLength < 2)
+		return -1;
+
+	auto const Conversion = Spec[SpecLength - 1];
+	auto const Modifier = Spec[SpecLength - 2];
+
+	va_list Arguments;
+	va_start(Arguments, InSpec);
+
+	std::vector<WCHAR> Output;
+
+	if (Conversion == 's' || Conversion == 'c')
+	{
+		// 
+		// The characters may be UTF-16, which the printf of this runtime cannot read: pad them here.
+		// 
+
+		if (Conversion == 's')
+		{
+			auto const* Value = (CONST UCHAR*) va_arg(Arguments, CONST VOID*);
+			auto const* Precision = strchr(Spec, '.');
+			auto const NumberOfCharacters = Precision != nullptr ? strtoul(Precision + 1, nullptr, 10) : 0;
+
+			for (ULONG CharacterIdx = 0; CharacterIdx < NumberOfCharacters; ++CharacterIdx)
+			{
+				WCHAR Character;
+
+				if (Modifier == 'l')
+					memcpy(&Character, Value + CharacterIdx * sizeof(WCHAR), sizeof(WCHAR));
+				else
+					Character = Value[CharacterIdx];
+
+				Output.push_back(Character);
+			}
+		}
+		else
+		{
+			auto const Value = va_arg(Arguments, int);
+			Output.push_back(Modifier == 'l' ? (WCHAR) Value : (WCHAR) (UCHAR) Value);
+		}
+
+		auto const IsLeftAligned = strchr(Spec, '-') != nullptr;
+		auto* Width = Spec + 1;
+
+		while (*Width == '-' || *Width == '+' || *Width == ' ' || *Width == '#' || *Width == '0')
+			++Width;
+
+		auto const Padding = (SIZE_T) strtoul(Width, nullptr, 10);
+
+		if (Output.size() < Padding)
+			Output.insert(IsLeftAligned ? Output.end() : Output.begin(), Padding - Output.size(), (WCHAR) ' ');
+	}
+	else
+	{
+		CHAR Text[512];
+		int TextLength;
+
+		if (Conversion == 'p')
+		{
+			// 
+			// The Windows runtime prints pointers as 16 uppercase hexadecimal digits, without any prefix.
+			// 
+
+			strcpy(Spec + SpecLength - 1, strchr(Spec, '.') != nullptr ? "llX" : ".16llX");
+			TextLength = snprintf(Text, sizeof(Text), Spec, (unsigned long long) (ULONG_PTR) va_arg(Arguments, PVOID));
+		}
+		else if (strchr("eEfFgGaA", Conversion) != nullptr)
+			TextLength = snprintf(Text, sizeof(Text), Spec, va_arg(Arguments, double));
+		else if (Modifier == 'l')
+			TextLength = snprintf(Text, sizeof(Text), Spec, (long long) va_arg(Arguments, LONG64));
+		else
+			TextLength = snprintf(Text, sizeof(Text), Spec, (int) va_arg(Arguments, INT32));
+
+		if (TextLength < 0 || TextLength >= (int) sizeof(Text))
+			TextLength = -1;
+
+		for (int CharacterIdx = 0; CharacterIdx < TextLength; ++CharacterIdx)
+			Output.push_back((WCHAR) (UCHAR) Text[CharacterIdx]);
+
+		if (TextLength < 0)
+		{
+			va_end(Arguments);
+			return -1;
+		}
+	}
+
+	va_end(Arguments);
+
+	auto const NumberOfCharacters = Output.size() < InCount ? Output.size() : InCount;
+
+	if (NumberOfCharacters != 0)
+		memcpy(OutBuffer, Output.data(), NumberOfCharacters * sizeof(WCHAR));
+
+	return Output.size() <= InCount ? (int) Output.size() : -1;
+}
+
+#endif
+
+#include "../../src/Headers/LogShardLayout.h"
+#include "../../src/Headers/LogFormat.h"
+
+/// <summary>
+/// The tag of every level of severity, indexed by their value, the last one being used for unknown levels.
+/// </summary>
+static CONST CHAR* CONST LevelTags[] =
+{
+	" TRACE : ",
+	" DEBUG : ",
+	"  INF  : ",
+	"  WRN  : ",
+	" ERROR : ",
+	" FATAL : ",
+	"  UNK  : ",
+};
+
+/// <summary>
+/// Reads the records of a single shard, one at a time.
+/// </summary>
+struct LogShardReader
+{
+	/// <summary>
+	/// The path to the shard.
+	/// </summary>
+	CONST CHAR* Path = nullptr;
+
+	/// <summary>
+	/// The shard file.
+	/// </summary>
+	FILE* File = nullptr;
+
+	/// <summary>
+	/// The offset of the next record in the shard.
+	/// </summary>
+	ULONG64 Offset = 0;
+
+	/// <summary>
+	/// The number of records read so far.
+	/// </summary>
+	ULONG64 NumberOfRecords = 0;
+
+	/// <summary>
+	/// The index of the shard, which is also the index of the processor its event records were logged from, unless several processors share it.
+	/// </summary>
+	ULONG ShardIndex = 0;
+
+	/// <summary>
+	/// The header of the current record.
+	/// </summary>
+	LOG_SHARD_RECORD Record = { };
+
+	/// <summary>
+	/// The message of the current record, rendered if it was stored as an event.
+	/// </summary>
+	WCHAR* Message = nullptr;
+
+	/// <summary>
+	/// The encoded arguments of the current record, if it was stored as an event.
+	/// </summary>
+	UCHAR* Arguments = nullptr;
+
+	/// <summary>
+	/// The format strings defined so far in the shard, null-terminated, indexed by their identifier.
+	/// </summary>
+	std::vector<std::vector<WCHAR>> Strings;
+
+	/// <summary>
+	/// Opens a shard, and checks its header.
+	/// </summary>
+	/// <param name="InPath">The path to the shard.</param>
+	BOOLEAN Open(CONST CHAR* InPath)
+	{
+		this->Path = InPath;
+		this->File = fopen(InPath, "rb");
+
+		if (this->File == nullptr)
+		{
+			fprintf(stderr, "%s: cannot be opened.\n", InPath);
+			return FALSE;
+		}
+
+		LOG_SHARD_HEADER Header = { };
+
+		if (fread(&Header, sizeof(Header), 1, this->File) != 1 ||
+			Header.Magic != LOG_SHARD_MAGIC ||
+			Header.Version == 0 ||
+			Header.Version > LOG_SHARD_VERSION ||
+			Header.HeaderSize < sizeof(Header) ||
+			fseeko(this->File, Header.HeaderSize, SEEK_SET) != 0)
+		{
+			fprintf(stderr, "%s: is not a shard.\n", InPath);
+			this->Close();
+			return FALSE;
+		}
+
+		this->Offset = Header.HeaderSize;
+		this->ShardIndex = Header.ShardIndex;
+		this->Message = (WCHAR*) malloc((LOG_SHARD_MAXIMUM_MESSAGE_LENGTH + 1) * sizeof(WCHAR));
+		this->Arguments = (UCHAR*) malloc(LOG_SHARD_MAXIMUM_ARGUMENTS_LENGTH);
+		this->Strings.resize(LOG_SHARD_MAXIMUM_STRINGS);
+
+		if (this->Message == nullptr || this->Arguments == nullptr)
+		{
+			this->Close();
+			return FALSE;
+		}
+
+		return TRUE;
+	}
+
+	/// <summary>
+	/// Reads the next text or event record of the shard, and the definition records preceding it.
+	/// </summary>
+	/// <returns>FALSE once the end of the shard, or a truncated record, has been reached.</returns>
+	BOOLEAN ReadNext()
+	{
+		while (TRUE)
+		{
+			ULONG Magic;
+			auto const MagicRead = fread(&Magic, 1, sizeof(Magic), this->File);
+
+			if (MagicRead == 0 && feof(this->File))
+				return FALSE;
+
+			if (MagicRead != sizeof(Magic))
+				return this->ReportTruncatedTail();
+
+			switch (Magic)
+			{
+				case LOG_SHARD_RECORD_MAGIC:
+					return this->ReadText();
+
+				case LOG_SHARD_EVENT_MAGIC:
+					return this->ReadEvent();
+
+				case LOG_SHARD_STRING_MAGIC:
+				{
+					if (!this->ReadString())
+						return FALSE;
+
+					continue;
+				}
+
+				default:
+					return this->ReportTruncatedTail();
+			}
+		}
+	}
+
+	/// <summary>
+	/// Reads the rest of a text record, after its magic.
+	/// </summary>
+	/// <returns>FALSE if the record is truncated.</returns>
+	BOOLEAN ReadText()
+	{
+		this->Record.Magic = LOG_SHARD_RECORD_MAGIC;
+
+		if (!this->ReadHeader(&this->Record, sizeof(this->Record)) || !LogShardIsRecordValid(&this->Record))
+			return this->ReportTruncatedTail();
+
+		auto const MessageSize = this->Record.MessageLength * sizeof(WCHAR);
+
+		if (fread(this->Message, 1, MessageSize, this->File) != MessageSize ||
+			LogShardChecksum(this->Message, MessageSize) != this->Record.Checksum)
+			return this->ReportTruncatedTail();
+
+		this->Offset += this->Record.Size;
+		this->NumberOfRecords++;
+		return TRUE;
+	}
+
+	/// <summary>
+	/// Reads the rest of an event record, after its magic, and renders its message.
+	/// </summary>
+	/// <returns>FALSE if the record is truncated, or references a format string which was not defined.</returns>
+	BOOLEAN ReadEvent()
+	{
+		LOG_SHARD_EVENT Event;
+		Event.Magic = LOG_SHARD_EVENT_MAGIC;
+
+		if (!this->ReadHeader(&Event, sizeof(Event)) || !LogShardIsEventValid(&Event) || this->Strings[Event.StringId].empty())
+			return this->ReportTruncatedTail();
+
+		auto const ArgumentsLength = Event.Size - (ULONG) sizeof(Event);
+
+		if (fread(this->Arguments, 1, ArgumentsLength, this->File) != ArgumentsLength ||
+			LogShardChecksum(this->Arguments, ArgumentsLength) != Event.Checksum)
+			return this->ReportTruncatedTail();
+
+		auto const& Format = this->Strings[Event.StringId];
+
+		auto const MessageLength = LogFormatRender(Format.data(), this->Arguments, ArgumentsLength, this->Message, LOG_SHARD_MAXIMUM_MESSAGE_LENGTH + 1);
+
+		// 
+		// From now on, the record is handled as if its message had been stored as text.
+		// 
+
+		this->Record.Size = Event.Size;
+		this->Record.Timestamp = Event.Timestamp;
+		this->Record.Sequence = Event.Sequence;
+		this->Record.Level = Event.Level;
+		this->Record.ProcessorIndex = this->ShardIndex;
+		this->Record.MessageLength = (ULONG) MessageLength;
+
+		this->Offset += Event.Size;
+		this->NumberOfRecords++;
+		return TRUE;
+	}
+
+	/// <summary>
+	/// Reads the rest of a definition record, after its magic, and defines its format string.
+	/// </summary>
+	/// <returns>FALSE if the record is truncated.</returns>
+	BOOLEAN ReadString()
+	{
+		LOG_SHARD_STRING String;
+		String.Magic = LOG_SHARD_STRING_MAGIC;
+
+		if (!this->ReadHeader(&String, sizeof(String)) || !LogShardIsStringValid(&String))
+			return this->ReportTruncatedTail();
+
+		auto const FormatSize = String.Size - (ULONG) sizeof(String);
+		std::vector<WCHAR> Format(FormatSize / sizeof(WCHAR) + 1);
+
+		if (fread(Format.data(), 1, FormatSize, this->File) != FormatSize ||
+			LogShardChecksum(Format.data(), FormatSize) != String.Checksum)
+			return this->ReportTruncatedTail();
+
+		Format.back() = 0;
+		this->Strings[String.StringId] = std::move(Format);
+		this->Offset += String.Size;
+		return TRUE;
+	}
+
+	/// <summary>
+	/// Reads the header of a record, after its magic which was already read.
+	/// </summary>
+	/// <param name="OutHeader">The header, whose magic is already set.</param>
+	/// <param name="InSize">The size of the header, including its magic.</param>
+	BOOLEAN ReadHeader(VOID* OutHeader, SIZE_T InSize)
+	{
+		return fread((UCHAR*) OutHeader + sizeof(ULONG), 1, InSize - sizeof(ULONG), this->File) == InSize - sizeof(ULONG);
+	}
+
+	/// <summary>
+	/// Reports the bytes following the last valid record, which are ignored.
+	/// </summary>
+	/// <returns>Always FALSE.</returns>
+	BOOLEAN ReportTruncatedTail()
+	{
+		fseeko(this->File, 0, SEEK_END);
+		auto const FileSize = (ULONG64) ftello(this->File);
+
+		fprintf(stderr, "%s: truncated after %llu records, ignoring the last %llu bytes.\n",
+			this->Path,
+			(unsigned long long) this->NumberOfRecords,
+			(unsigned long long) (FileSize - this->Offset));
+
+		return FALSE;
+	}
+
+	/// <summary>
+	/// Closes the shard.
+	/// </summary>
+	void Close()
+	{
+		if (this->File != nullptr)
+			fclose(this->File);
+
+		free(this->Message);
+		free(this->Arguments);
+		this->File = nullptr;
+		this->Message = nullptr;
+		this->Arguments = nullptr;
+		this->Strings.clear();
+	}
+};
+
+/// <summary>
+/// Orders the readers by the timestamp of their current record, then by its processor and its sequence number, the earliest first.
+/// </summary>
+struct LogShardReaderLater
+{
+	bool operator()(CONST LogShardReader* InLeft, CONST LogShardReader* InRight) CONST
+	{
+		if (InLeft->Record.Timestamp != InRight->Record.Timestamp)
+			return InLeft->Record.Timestamp > InRight->Record.Timestamp;
+
+		if (InLeft->Record.ProcessorIndex != InRight->Record.ProcessorIndex)
+			return InLeft->Record.ProcessorIndex > InRight->Record.ProcessorIndex;
+
+		return InLeft->Record.Sequence > InRight->Record.Sequence;
+	}
+};
+
+/// <summary>
+/// Writes a number with a fixed number of digits.
+/// </summary>
+/// <param name="InOutCursor">The output cursor, advanced past the digits.</param>
+/// <param name="InValue">The number.</param>
+/// <param name="InNumberOfDigits">The number of digits, the number being padded with zeros.</param>
+static void WriteDigits(CHAR*& InOutCursor, ULONG64 InValue, ULONG InNumberOfDigits)
+{
+	for (ULONG DigitIdx = InNumberOfDigits; DigitIdx != 0; --DigitIdx)
+	{
+		InOutCursor[DigitIdx - 1] = (CHAR) ('0' + InValue % 10);
+		InValue /= 10;
+	}
+
+	InOutCursor += InNumberOfDigits;
+}
+
+/// <summary>
+/// Writes a system time, in 100 nanoseconds intervals since January 1st 1601, as a UTC date and time.
+/// </summary>
+/// <param name="InOutCursor">The output cursor, advanced past the date and time.</param>
+/// <param name="InTimestamp">The system time.</param>
+static void WriteTimestamp(CHAR*& InOutCursor, LONG64 InTimestamp)
+{
+	if (InTimestamp < 0)
+		InTimestamp = 0;
+
+	auto const IntervalsPerDay = 864000000000LL;
+	auto const Days = InTimestamp / IntervalsPerDay;
+	auto const IntervalsOfDay = InTimestamp % IntervalsPerDay;
+
+	// 
+	// Convert the number of days to a civil date, from the days since March 1st 0000.
+	// 
+
+	auto const DaysSinceEpoch = Days + 584694;
+	auto const Era = DaysSinceEpoch / 146097;
+	auto const DayOfEra = DaysSinceEpoch - Era * 146097;
+	auto const YearOfEra = (DayOfEra - DayOfEra / 1460 + DayOfEra / 36524 - DayOfEra / 146096) / 365;
+	auto const DayOfYear = DayOfEra - (365 * YearOfEra + YearOfEra / 4 - YearOfEra / 100);
+	auto const ShiftedMonth = (5 * DayOfYear + 2) / 153;
+	auto const Day = DayOfYear - (153 * ShiftedMonth + 2) / 5 + 1;
+	auto const Month = ShiftedMonth < 10 ? ShiftedMonth + 3 : ShiftedMonth - 9;
+	auto const Year = YearOfEra + Era * 400 + (Month <= 2 ? 1 : 0);
+
+	WriteDigits(InOutCursor, (ULONG64) Year, 4);
+	*InOutCursor++ = '-';
+	WriteDigits(InOutCursor, (ULONG64) Month, 2);
+	*InOutCursor++ = '-';
+	WriteDigits(InOutCursor, (ULONG64) Day, 2);
+	*InOutCursor++ = ' ';
+	WriteDigits(InOutCursor, (ULONG64) (IntervalsOfDay / 36000000000LL), 2);
+	*InOutCursor++ = ':';
+	WriteDigits(InOutCursor, (ULONG64) (IntervalsOfDay / 600000000LL % 60), 2);
+	*InOutCursor++ = ':';
+	WriteDigits(InOutCursor, (ULONG64) (IntervalsOfDay / 10000000LL % 60), 2);
+	*InOutCursor++ = '.';
+	WriteDigits(InOutCursor, (ULONG64) (IntervalsOfDay % 10000000LL), 7);
+}
+
+/// <summary>
+/// Converts a message from UTF-16 to UTF-8.
+/// </summary>
+/// <param name="InOutCursor">The output cursor, advanced past the converted message.</param>
+/// <param name="InMessage">The message.</param>
+/// <param name="InLength">The number of characters of the message.</param>
+static void WriteMessage(CHAR*& InOutCursor, CONST WCHAR* InMessage, SIZE_T InLength)
+{
+	for (SIZE_T CharacterIdx = 0; CharacterIdx < InLength; ++CharacterIdx)
+	{
+		ULONG CodePoint = InMessage[CharacterIdx];
+
+		if (CodePoint >= 0xD800 && CodePoint < 0xDC00 && CharacterIdx + 1 < InLength &&
+			InMessage[CharacterIdx + 1] >= 0xDC00 && InMessage[CharacterIdx + 1] < 0xE000)
+		{
+			CodePoint = 0x10000 + ((CodePoint - 0xD800) << 10) + (InMessage[++CharacterIdx] - 0xDC00);
+		}
+		else if (CodePoint >= 0xD800 && CodePoint < 0xE000)
+		{
+			CodePoint = 0xFFFD;
+		}
+
+		if (CodePoint < 0x80)
+		{
+			*InOutCursor++ = (CHAR) CodePoint;
+		}
+		else if (CodePoint < 0x800)
+		{
+			*InOutCursor++ = (CHAR) (0xC0 | (CodePoint >> 6));
+			*InOutCursor++ = (CHAR) (0x80 | (CodePoint & 0x3F));
+		}
+		else if (CodePoint < 0x10000)
+		{
+			*InOutCursor++ = (CHAR) (0xE0 | (CodePoint >> 12));
+			*InOutCursor++ = (CHAR) (0x80 | ((CodePoint >> 6) & 0x3F));
+			*InOutCursor++ = (CHAR) (0x80 | (CodePoint & 0x3F));
+		}
+		else
+		{
+			*InOutCursor++ = (CHAR) (0xF0 | (CodePoint >> 18));
+			*InOutCursor++ = (CHAR) (0x80 | ((CodePoint >> 12) & 0x3F));
+			*InOutCursor++ = (CHAR) (0x80 | ((CodePoint >> 6) & 0x3F));
+			*InOutCursor++ = (CHAR) (0x80 | (CodePoint & 0x3F));
+		}
+	}
+}
+
+/// <summary>
+/// The buffer a single record is rendered into: its header, and its message converted to UTF-8.
+/// </summary>
+static CHAR OutputBuffer[64 + LOG_SHARD_MAXIMUM_MESSAGE_LENGTH * 3 + 1];
+
+int main(int InArgc, char** InArgv)
+{
+	if (InArgc < 2)
+	{
+		fprintf(stderr, "Usage: %s <shard> [<shard> ...]\n", InArgv[0]);
+		return 1;
+	}
+
+	// 
+	// Open every shard, and read its first record.
+	// 
+
+	std::vector<LogShardReader> Readers((SIZE_T) (InArgc - 1));
+	std::vector<LogShardReader*> Heap;
+	Heap.reserve(Readers.size());
+
+	std::priority_queue<LogShardReader*, std::vector<LogShardReader*>, LogShardReaderLater> Pending(LogShardReaderLater(), std::move(Heap));
+
+	for (SIZE_T ReaderIdx = 0; ReaderIdx < Readers.size(); ++ReaderIdx)
+	{
+		auto& Reader = Readers[ReaderIdx];
+
+		if (!Reader.Open(InArgv[ReaderIdx + 1]))
+			continue;
+
+		if (Reader.ReadNext())
+			Pending.push(&Reader);
+	}
+
+	// 
+	// Write the earliest record of all the shards, and replace it with the next record of its shard.
+	// 
+
+	ULONG64 NumberOfRecords = 0;
+
+	while (!Pending.empty())
+	{
+		auto* Reader = Pending.top();
+		Pending.pop();
+
+		auto* Cursor = OutputBuffer;
+		auto const LevelIdx = Reader->Record.Level < sizeof(LevelTags) / sizeof(*LevelTags) - 1 ? Reader->Record.Level : (ULONG) (sizeof(LevelTags) / sizeof(*LevelTags) - 1);
+
+		*Cursor++ = '[';
+		WriteTimestamp(Cursor, Reader->Record.Timestamp);
+		*Cursor++ = ']';
+		Cursor += sprintf(Cursor, " [CPU %lu]", (unsigned long) Reader->Record.ProcessorIndex);
+		Cursor += sprintf(Cursor, "%s", LevelTags[LevelIdx]);
+		WriteMessage(Cursor, Reader->Message, Reader->Record.MessageLength);
+		*Cursor++ = '\n';
+
+		fwrite(OutputBuffer, 1, (SIZE_T) (Cursor - OutputBuffer), stdout);
+		NumberOfRecords++;
+
+		if (Reader->ReadNext())
+			Pending.push(Reader);
+	}
+
+	// 
+	// Release the shards.
+	// 
+
+	for (auto& Reader : Readers)
+		Reader.Close();
+
+	fprintf(stderr, "%llu records merged from %zu shards.\n", (unsigned long long) NumberOfRecords, Readers.size());
+	return 0;
+}